@@ -0,0 +1,35 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/source/device_properties.cpp" "CMakeFiles/haze-host.dir/root/repo/source/device_properties.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/device_properties.cpp.o.d"
+  "/root/repo/source/event_reactor.cpp" "CMakeFiles/haze-host.dir/root/repo/source/event_reactor.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/event_reactor.cpp.o.d"
+  "/root/repo/source/loopback_transport.cpp" "CMakeFiles/haze-host.dir/root/repo/source/loopback_transport.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/loopback_transport.cpp.o.d"
+  "/root/repo/source/ptp_directory_cache.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_directory_cache.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_directory_cache.cpp.o.d"
+  "/root/repo/source/ptp_event_queue.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_event_queue.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_event_queue.cpp.o.d"
+  "/root/repo/source/ptp_object_database.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_database.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_database.cpp.o.d"
+  "/root/repo/source/ptp_object_heap.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_heap.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_heap.cpp.o.d"
+  "/root/repo/source/ptp_object_prefetcher.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_prefetcher.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_prefetcher.cpp.o.d"
+  "/root/repo/source/ptp_object_snapshot.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_snapshot.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_snapshot.cpp.o.d"
+  "/root/repo/source/ptp_responder.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder.cpp.o.d"
+  "/root/repo/source/ptp_responder_mtp_operations.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_mtp_operations.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_mtp_operations.cpp.o.d"
+  "/root/repo/source/ptp_responder_ptp_operations.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_ptp_operations.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_ptp_operations.cpp.o.d"
+  "/root/repo/source/ptp_string.cpp" "CMakeFiles/haze-host.dir/root/repo/source/ptp_string.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/ptp_string.cpp.o.d"
+  "/root/repo/source/threaded_file_transfer.cpp" "CMakeFiles/haze-host.dir/root/repo/source/threaded_file_transfer.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/threaded_file_transfer.cpp.o.d"
+  "/root/repo/source/transfer_tuner.cpp" "CMakeFiles/haze-host.dir/root/repo/source/transfer_tuner.cpp.o" "gcc" "CMakeFiles/haze-host.dir/root/repo/source/transfer_tuner.cpp.o.d"
+  "/root/repo/host/source/main.cpp" "CMakeFiles/haze-host.dir/source/main.cpp.o" "gcc" "CMakeFiles/haze-host.dir/source/main.cpp.o.d"
+  "/root/repo/host/source/switch_shim.cpp" "CMakeFiles/haze-host.dir/source/switch_shim.cpp.o" "gcc" "CMakeFiles/haze-host.dir/source/switch_shim.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
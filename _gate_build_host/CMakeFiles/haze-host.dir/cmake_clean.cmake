@@ -0,0 +1,43 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/haze-host.dir/root/repo/source/device_properties.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/device_properties.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/event_reactor.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/event_reactor.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/loopback_transport.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/loopback_transport.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_directory_cache.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_directory_cache.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_event_queue.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_event_queue.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_database.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_database.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_heap.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_heap.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_prefetcher.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_prefetcher.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_snapshot.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_object_snapshot.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_mtp_operations.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_mtp_operations.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_ptp_operations.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_responder_ptp_operations.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_string.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/ptp_string.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/threaded_file_transfer.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/threaded_file_transfer.cpp.o.d"
+  "CMakeFiles/haze-host.dir/root/repo/source/transfer_tuner.cpp.o"
+  "CMakeFiles/haze-host.dir/root/repo/source/transfer_tuner.cpp.o.d"
+  "CMakeFiles/haze-host.dir/source/main.cpp.o"
+  "CMakeFiles/haze-host.dir/source/main.cpp.o.d"
+  "CMakeFiles/haze-host.dir/source/switch_shim.cpp.o"
+  "CMakeFiles/haze-host.dir/source/switch_shim.cpp.o.d"
+  "haze-host"
+  "haze-host.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/haze-host.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
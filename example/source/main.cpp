@@ -76,6 +76,15 @@ struct FsNative : haze::FileSystemProxyImpl {
     Result ReadFile(FsFile *file, s64 off, void *buf, u64 read_size, u32 option, u64 *out_bytes_read) override {
         return fsFileRead(file, off, buf, read_size, option, out_bytes_read);
     }
+    u32 GetReadThreadCount(s64 size) override {
+        return 2;
+    }
+    u32 GetWriteThreadCount(s64 size) override {
+        return 2;
+    }
+    u32 GetWriteAlignment(s64 size) override {
+        return 1024 * 1024;
+    }
     Result WriteFile(FsFile *file, s64 off, const void *buf, u64 write_size, u32 option) override {
         return fsFileWrite(file, off, buf, write_size, option);
     }
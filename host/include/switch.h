@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+/* The parts of libnx that libhaze uses, for building the PTP layer on a Linux host. */
+/* Types match libnx closely enough for the library to compile unchanged. Only the threading, */
+/* synchronisation and timing functions are implemented, see switch_shim.cpp. USB and fs are declared only. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+typedef __uint128_t u128;
+typedef __int128_t  s128;
+
+typedef volatile u8  vu8;
+typedef volatile u16 vu16;
+typedef volatile u32 vu32;
+typedef volatile u64 vu64;
+typedef volatile s8  vs8;
+typedef volatile s16 vs16;
+typedef volatile s32 vs32;
+typedef volatile s64 vs64;
+
+typedef u32 Result;
+typedef u32 Handle;
+
+#define R_SUCCEEDED(res)   ((res)==0)
+#define R_FAILED(res)      ((res)!=0)
+#define R_VALUE(res)       ((res))
+#define R_MODULE(res)      ((res)&0x1FF)
+#define R_DESCRIPTION(res) (((res)>>9)&0x1FFF)
+#define MAKERESULT(module,description) ((((module)&0x1FF)) | ((description)&0x1FFF)<<9)
+
+#define BIT(n) (1U<<(n))
+
+#define CUR_PROCESS_HANDLE 0xFFFF8001
+#define INVALID_HANDLE     0
+#define FS_MAX_PATH        0x301
+
+/* Threads and synchronisation. */
+typedef u32 Mutex;
+typedef u32 CondVar;
+
+typedef void (*ThreadFunc)(void *);
+
+typedef struct {
+    Handle handle;
+} Thread;
+
+typedef struct {
+    u32 signaled;
+    bool auto_clear;
+} UEvent;
+
+typedef struct {
+    Handle revent;
+    Handle wevent;
+    bool autoclear;
+} Event;
+
+typedef enum {
+    WaiterType_Handle,
+    WaiterType_UEvent,
+} WaiterType;
+
+typedef struct {
+    WaiterType type;
+    union {
+        Handle handle;
+        UEvent *event;
+    };
+} Waiter;
+
+typedef enum {
+    InfoType_CoreMask        = 0,
+    InfoType_TotalMemorySize = 6,
+    InfoType_UsedMemorySize  = 7,
+} InfoType;
+
+typedef enum {
+    BreakReason_Panic  = 0,
+    BreakReason_Assert = 1,
+} BreakReason;
+
+/* Filesystem. */
+typedef struct { u64 s; } FsFile;
+typedef struct { u64 s; } FsDir;
+typedef struct { u64 s; } FsFileSystem;
+
+typedef enum {
+    FsDirEntryType_Dir  = 0,
+    FsDirEntryType_File = 1,
+} FsDirEntryType;
+
+typedef struct {
+    char name[FS_MAX_PATH];
+    u8 pad[3];
+    s8 type;
+    u8 pad2[3];
+    s64 file_size;
+} FsDirectoryEntry;
+
+typedef enum {
+    FsOpenMode_Read   = BIT(0),
+    FsOpenMode_Write  = BIT(1),
+    FsOpenMode_Append = BIT(2),
+} FsOpenMode;
+
+typedef enum {
+    FsDirOpenMode_ReadDirs   = BIT(0),
+    FsDirOpenMode_ReadFiles  = BIT(1),
+    FsDirOpenMode_NoFileSize = BIT(31),
+} FsDirOpenMode;
+
+typedef enum { FsReadOption_None = 0 } FsReadOption;
+typedef enum { FsWriteOption_None = 0, FsWriteOption_Flush = BIT(0) } FsWriteOption;
+typedef enum { FsCreateOption_BigFile = BIT(0) } FsCreateOption;
+
+/* System settings. */
+typedef struct { char number[0x18]; } SetSysSerialNumber;
+typedef struct { u8 pad[0x68]; char display_version[0x18]; } SetSysFirmwareVersion;
+
+/* USB device. */
+typedef struct { u8 bInterfaceClass, bInterfaceSubClass, bInterfaceProtocol; } UsbCommsInterfaceInfo;
+typedef struct { Event CompletionEvent; } UsbDsEndpoint;
+typedef struct { u8 interface_index; Event SetupEvent; Event CtrlInCompletionEvent; Event CtrlOutCompletionEvent; } UsbDsInterface;
+typedef struct { u32 id; u32 requestedSize; u32 transferredSize; u32 urb_status; } UsbDsReportEntry;
+typedef struct { UsbDsReportEntry report[8]; u32 report_count; } UsbDsReportData;
+typedef enum { UsbState_Configured = 5 } UsbState;
+typedef enum { UsbDeviceSpeed_Full = 2, UsbDeviceSpeed_High = 3, UsbDeviceSpeed_Super = 4 } UsbDeviceSpeed;
+
+#define USB_DT_DEVICE                1
+#define USB_DT_INTERFACE             4
+#define USB_DT_ENDPOINT              5
+#define USB_DT_BOS                   0xF
+#define USB_DT_DEVICE_CAPABILITY     0x10
+#define USB_DT_SS_ENDPOINT_COMPANION 0x30
+#define USB_DT_DEVICE_SIZE                18
+#define USB_DT_INTERFACE_SIZE             9
+#define USB_DT_ENDPOINT_SIZE              7
+#define USB_DT_SS_ENDPOINT_COMPANION_SIZE 6
+#define USB_ENDPOINT_IN  0x80
+#define USB_ENDPOINT_OUT 0x00
+#define USB_TRANSFER_TYPE_BULK      2
+#define USB_TRANSFER_TYPE_INTERRUPT 3
+
+struct usb_interface_descriptor { u8 bLength, bDescriptorType, bInterfaceNumber, bAlternateSetting, bNumEndpoints, bInterfaceClass, bInterfaceSubClass, bInterfaceProtocol, iInterface; };
+struct usb_endpoint_descriptor { u8 bLength, bDescriptorType, bEndpointAddress, bmAttributes; u16 wMaxPacketSize; u8 bInterval; };
+struct usb_ss_endpoint_companion_descriptor { u8 bLength, bDescriptorType, bMaxBurst, bmAttributes; u16 wBytesPerInterval; };
+struct usb_device_descriptor { u8 bLength, bDescriptorType; u16 bcdUSB; u8 bDeviceClass, bDeviceSubClass, bDeviceProtocol, bMaxPacketSize0; u16 idVendor, idProduct, bcdDevice; u8 iManufacturer, iProduct, iSerialNumber, bNumConfigurations; };
+typedef struct { u8 bmRequestType, bRequest; u16 wValue, wIndex, wLength; } UsbDsSetup;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Implemented by the shim. */
+void svcBreak(u32 reason, u64 address, u64 size);
+Result svcGetInfo(u64 *out, u32 id0, Handle handle, u64 id1);
+Result svcSetThreadCoreMask(Handle handle, s32 preferred_core, u64 affinity_mask);
+void svcSleepThread(s64 nano);
+
+u64 armGetSystemTick(void);
+u64 armTicksToNs(u64 tick);
+u64 armNsToTicks(u64 ns);
+
+Result threadCreate(Thread *t, ThreadFunc entry, void *arg, void *stack_mem, size_t stack_sz, int prio, int cpuid);
+Result threadStart(Thread *t);
+Result threadWaitForExit(Thread *t);
+Result threadClose(Thread *t);
+
+void mutexInit(Mutex *m);
+void mutexLock(Mutex *m);
+bool mutexTryLock(Mutex *m);
+void mutexUnlock(Mutex *m);
+
+void condvarInit(CondVar *c);
+Result condvarWait(CondVar *c, Mutex *m);
+Result condvarWaitTimeout(CondVar *c, Mutex *m, u64 timeout);
+Result condvarWakeOne(CondVar *c);
+Result condvarWakeAll(CondVar *c);
+
+void ueventCreate(UEvent *e, bool auto_clear);
+void ueventSignal(UEvent *e);
+void ueventClear(UEvent *e);
+
+Waiter waiterForUEvent(UEvent *e);
+Waiter waiterForHandle(Handle h);
+Result waitObjects(s32 *idx_out, const Waiter *objects, s32 num_objects, u64 timeout);
+Result waitSingle(Waiter w, u64 timeout);
+
+#define waitMulti(idx_out, timeout, ...) ({ \
+    Waiter __objects[] = { __VA_ARGS__ }; \
+    waitObjects((idx_out), __objects, sizeof(__objects) / sizeof(Waiter), (timeout)); \
+})
+
+Result setsysInitialize(void);
+void setsysExit(void);
+Result setsysGetSerialNumber(SetSysSerialNumber *out);
+Result setsysGetFirmwareVersion(SetSysFirmwareVersion *out);
+
+/* Declared only, for the USB server and the native filesystem, which aren't built for the host. */
+Waiter waiterForEvent(Event *e);
+Result eventWait(Event *e, u64 timeout);
+Result eventClear(Event *e);
+
+Result usbDsInitialize(void);
+void usbDsExit(void);
+Result usbDsEnable(void);
+Result usbDsGetState(UsbState *out);
+Event *usbDsGetStateChangeEvent(void);
+Result usbDsRegisterInterface(UsbDsInterface **out);
+Result usbDsAddUsbStringDescriptor(u8 *out_index, const char *string);
+Result usbDsAddUsbLanguageStringDescriptor(u8 *out_index, const u16 *lang_ids, u16 num_langs);
+Result usbDsSetUsbDeviceDescriptor(UsbDeviceSpeed speed, struct usb_device_descriptor *descriptor);
+Result usbDsSetBinaryObjectStore(const void *bos, size_t size);
+Result usbDsInterface_AppendConfigurationData(UsbDsInterface *interface, UsbDeviceSpeed speed, const void *buffer, size_t size);
+Result usbDsInterface_RegisterEndpoint(UsbDsInterface *interface, UsbDsEndpoint **endpoint, u8 endpoint_address);
+Result usbDsInterface_EnableInterface(UsbDsInterface *interface);
+Result usbDsInterface_GetSetupPacket(UsbDsInterface *interface, void *buffer, size_t size);
+Result usbDsInterface_CtrlInPostBufferAsync(UsbDsInterface *interface, void *buffer, size_t size, u32 *urb_id);
+Result usbDsInterface_CtrlOutPostBufferAsync(UsbDsInterface *interface, void *buffer, size_t size, u32 *urb_id);
+Result usbDsInterface_GetCtrlInReportData(UsbDsInterface *interface, UsbDsReportData *out);
+Result usbDsInterface_GetCtrlOutReportData(UsbDsInterface *interface, UsbDsReportData *out);
+Result usbDsInterface_StallCtrl(UsbDsInterface *interface);
+Result usbDsEndpoint_PostBufferAsync(UsbDsEndpoint *endpoint, void *buffer, size_t size, u32 *urb_id);
+Result usbDsEndpoint_GetReportData(UsbDsEndpoint *endpoint, UsbDsReportData *out);
+Result usbDsEndpoint_Cancel(UsbDsEndpoint *endpoint);
+Result usbDsEndpoint_Stall(UsbDsEndpoint *endpoint);
+Result usbDsEndpoint_SetZlt(UsbDsEndpoint *endpoint, bool zlt);
+Result usbDsParseReportData(UsbDsReportData *reportdata, u32 urb_id, u32 *requested_size, u32 *transferred_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,760 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/cancel_token.hpp>
+#include <haze/event_reactor.hpp>
+#include <haze/loopback_transport.hpp>
+#include <haze/ptp_data_builder.hpp>
+#include <haze/ptp_data_parser.hpp>
+#include <haze/ptp_event_queue.hpp>
+#include <haze/ptp_object_heap.hpp>
+#include <haze/ptp_responder.hpp>
+#include <haze/ptp_responder_types.hpp>
+#include <haze/threaded_file_transfer.hpp>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+/* Runs the responder against a folder on this machine, over a loopback link, and drives it as a pc would. */
+/* Usage: haze-host <folder> [upload MB] [link MB/s] [link latency us] */
+
+namespace haze {
+
+    namespace {
+
+        /* The fs results the responder cares about. */
+        constexpr ::Result ResultPathNotFound      = MAKERESULT(2, 1);
+        constexpr ::Result ResultPathAlreadyExists = MAKERESULT(2, 2);
+        constexpr ::Result ResultUnexpected        = MAKERESULT(2, 5000);
+
+        ::Result ErrnoToResult() {
+            switch (errno) {
+                case ENOENT: return ResultPathNotFound;
+                case EEXIST: return ResultPathAlreadyExists;
+                default:     return ResultUnexpected;
+            }
+        }
+
+        struct PosixDir {
+            DIR *dir;
+            std::string path;
+            u32 mode;
+        };
+
+        /* Paths from the responder start with a slash, and are relative to the folder. */
+        class PosixFs final : public FileSystemProxyImpl {
+            private:
+                std::string m_root;
+            private:
+                std::string FixPath(const char *path) const {
+                    return m_root + path;
+                }
+            public:
+                explicit PosixFs(const char *root) : m_root(root) { /* ... */ }
+
+                const char *GetName() const override { return ""; }
+                const char *GetDisplayName() const override { return "Host"; }
+
+                ::Result GetTotalSpace(const char *path, s64 *out) override {
+                    struct statvfs st;
+                    if (statvfs(this->FixPath(path).c_str(), std::addressof(st)) != 0) {
+                        return ErrnoToResult();
+                    }
+
+                    *out = static_cast<s64>(st.f_blocks) * st.f_frsize;
+                    return 0;
+                }
+
+                ::Result GetFreeSpace(const char *path, s64 *out) override {
+                    struct statvfs st;
+                    if (statvfs(this->FixPath(path).c_str(), std::addressof(st)) != 0) {
+                        return ErrnoToResult();
+                    }
+
+                    *out = static_cast<s64>(st.f_bavail) * st.f_frsize;
+                    return 0;
+                }
+
+                ::Result GetEntryType(const char *path, FsDirEntryType *out_entry_type) override {
+                    struct stat st;
+                    if (stat(this->FixPath(path).c_str(), std::addressof(st)) != 0) {
+                        return ErrnoToResult();
+                    }
+
+                    *out_entry_type = S_ISDIR(st.st_mode) ? FsDirEntryType_Dir : FsDirEntryType_File;
+                    return 0;
+                }
+
+                ::Result CreateFile(const char *path, s64 size, u32 option) override {
+                    const int fd = open(this->FixPath(path).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+                    if (fd < 0) {
+                        return ErrnoToResult();
+                    }
+
+                    const bool ok = ftruncate(fd, size) == 0;
+                    close(fd);
+                    return ok ? 0 : ErrnoToResult();
+                }
+
+                ::Result DeleteFile(const char *path) override {
+                    return unlink(this->FixPath(path).c_str()) == 0 ? 0 : ErrnoToResult();
+                }
+
+                ::Result RenameFile(const char *old_path, const char *new_path) override {
+                    return rename(this->FixPath(old_path).c_str(), this->FixPath(new_path).c_str()) == 0 ? 0 : ErrnoToResult();
+                }
+
+                ::Result OpenFile(const char *path, u32 mode, FsFile *out_file) override {
+                    const int fd = open(this->FixPath(path).c_str(), (mode & FsOpenMode_Write) ? O_RDWR : O_RDONLY);
+                    if (fd < 0) {
+                        return ErrnoToResult();
+                    }
+
+                    out_file->s = fd;
+                    return 0;
+                }
+
+                ::Result GetFileSize(FsFile *file, s64 *out_size) override {
+                    struct stat st;
+                    if (fstat(file->s, std::addressof(st)) != 0) {
+                        return ErrnoToResult();
+                    }
+
+                    *out_size = st.st_size;
+                    return 0;
+                }
+
+                ::Result SetFileSize(FsFile *file, s64 size) override {
+                    return ftruncate(file->s, size) == 0 ? 0 : ErrnoToResult();
+                }
+
+                ::Result ReadFile(FsFile *file, s64 off, void *buf, u64 read_size, u32 option, u64 *out_bytes_read) override {
+                    u64 total = 0;
+                    while (total < read_size) {
+                        const ssize_t n = pread(file->s, static_cast<u8 *>(buf) + total, read_size - total, off + total);
+                        if (n < 0) {
+                            return ErrnoToResult();
+                        } else if (n == 0) {
+                            break;
+                        }
+                        total += n;
+                    }
+
+                    *out_bytes_read = total;
+                    return 0;
+                }
+
+                ::Result WriteFile(FsFile *file, s64 off, const void *buf, u64 write_size, u32 option) override {
+                    u64 total = 0;
+                    while (total < write_size) {
+                        const ssize_t n = pwrite(file->s, static_cast<const u8 *>(buf) + total, write_size - total, off + total);
+                        if (n < 0) {
+                            return ErrnoToResult();
+                        }
+                        total += n;
+                    }
+
+                    return 0;
+                }
+
+                void CloseFile(FsFile *file) override {
+                    close(file->s);
+                }
+
+                /* As the example configures the sd card, so that the same transfer paths are taken. */
+                u32 GetReadThreadCount(s64 size) override { return 2; }
+                u32 GetWriteThreadCount(s64 size) override { return 2; }
+                u32 GetWriteAlignment(s64 size) override { return 1_MB; }
+
+                ::Result CreateDirectory(const char *path) override {
+                    return mkdir(this->FixPath(path).c_str(), 0755) == 0 ? 0 : ErrnoToResult();
+                }
+
+                ::Result DeleteDirectoryRecursively(const char *path) override {
+                    const auto remove_entry = [](const char *fpath, const struct stat *, int, struct FTW *) { return remove(fpath); };
+                    return nftw(this->FixPath(path).c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS) == 0 ? 0 : ErrnoToResult();
+                }
+
+                ::Result RenameDirectory(const char *old_path, const char *new_path) override {
+                    return this->RenameFile(old_path, new_path);
+                }
+
+                ::Result OpenDirectory(const char *path, u32 mode, FsDir *out_dir) override {
+                    const std::string full_path = this->FixPath(path);
+
+                    DIR *dir = opendir(full_path.c_str());
+                    if (dir == nullptr) {
+                        return ErrnoToResult();
+                    }
+
+                    out_dir->s = reinterpret_cast<u64>(new PosixDir{ .dir = dir, .path = full_path, .mode = mode });
+                    return 0;
+                }
+
+                ::Result ReadDirectory(FsDir *d, s64 *out_total_entries, size_t max_entries, FsDirectoryEntry *buf) override {
+                    auto *dir = reinterpret_cast<PosixDir *>(d->s);
+
+                    s64 count = 0;
+                    while (count < static_cast<s64>(max_entries)) {
+                        const dirent *ent = readdir(dir->dir);
+                        if (ent == nullptr) {
+                            break;
+                        }
+
+                        if (!std::strcmp(ent->d_name, ".") || !std::strcmp(ent->d_name, "..")) {
+                            continue;
+                        }
+
+                        struct stat st;
+                        if (fstatat(dirfd(dir->dir), ent->d_name, std::addressof(st), 0) != 0) {
+                            continue;
+                        }
+
+                        const bool is_dir = S_ISDIR(st.st_mode);
+                        if (!(dir->mode & (is_dir ? FsDirOpenMode_ReadDirs : FsDirOpenMode_ReadFiles))) {
+                            continue;
+                        }
+
+                        FsDirectoryEntry &entry = buf[count++];
+                        std::memset(std::addressof(entry), 0, sizeof(entry));
+                        std::snprintf(entry.name, sizeof(entry.name), "%s", ent->d_name);
+                        entry.type      = is_dir ? FsDirEntryType_Dir : FsDirEntryType_File;
+                        entry.file_size = is_dir ? 0 : st.st_size;
+                    }
+
+                    *out_total_entries = count;
+                    return 0;
+                }
+
+                ::Result GetDirectoryEntryCount(FsDir *d, s64 *out_count) override {
+                    auto *dir = reinterpret_cast<PosixDir *>(d->s);
+
+                    DIR *counter = opendir(dir->path.c_str());
+                    if (counter == nullptr) {
+                        return ErrnoToResult();
+                    }
+
+                    s64 count = 0;
+                    while (const dirent *ent = readdir(counter)) {
+                        count += std::strcmp(ent->d_name, ".") && std::strcmp(ent->d_name, "..");
+                    }
+
+                    closedir(counter);
+                    *out_count = count;
+                    return 0;
+                }
+
+                void CloseDirectory(FsDir *d) override {
+                    auto *dir = reinterpret_cast<PosixDir *>(d->s);
+                    closedir(dir->dir);
+                    delete dir;
+                }
+
+                bool GetModifiedTime(const char *path, u64 *out) override {
+                    struct stat st;
+                    if (stat(this->FixPath(path).c_str(), std::addressof(st)) != 0) {
+                        return false;
+                    }
+
+                    *out = static_cast<u64>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+                    return true;
+                }
+        };
+
+        /* The console side, set up as ConsoleMainLoop does, with the loopback link in place of usb. */
+        class Device final : EventConsumer {
+            private:
+                FsEntries m_entries;
+                const char *m_snapshot_path;
+                UEvent m_cancel_event;
+                CancelToken m_cancel_token;
+                EventReactor m_event_reactor;
+                PtpEventQueue m_event_queue;
+                LoopbackLink m_link;
+                std::thread m_thread;
+            public:
+                explicit Device(const FsEntries &entries, const char *snapshot_path) : m_entries(entries), m_snapshot_path(snapshot_path), m_cancel_event(), m_cancel_token(), m_event_reactor(), m_event_queue(), m_link(), m_thread() { /* ... */ }
+
+                Result Start(const LoopbackLinkModel &model) {
+                    ueventCreate(std::addressof(m_cancel_event), false);
+                    m_event_queue.Initialize();
+
+                    m_event_reactor.Initialize();
+                    m_event_reactor.SetResult(ResultSuccess());
+                    m_event_reactor.AddConsumer(this, waiterForUEvent(std::addressof(m_cancel_event)));
+
+                    m_cancel_token.Initialize();
+                    m_event_reactor.SetCancelToken(std::addressof(m_cancel_token));
+
+                    R_TRY(m_link.Initialize(std::addressof(m_event_reactor), model));
+
+                    m_thread = std::thread([this] { this->Run(); });
+                    R_SUCCEED();
+                }
+
+                void Stop() {
+                    m_cancel_token.Cancel(haze::ResultStopRequested());
+                    ueventSignal(std::addressof(m_cancel_event));
+                    m_thread.join();
+
+                    m_link.Finalize();
+                }
+
+                LoopbackTransport *GetHost() { return m_link.GetHost(); }
+            private:
+                void Run() {
+                    PtpObjectHeap ptp_object_heap;
+
+                    PtpResponder ptp_responder{nullptr};
+                    if (R_FAILED(ptp_responder.Initialize(std::addressof(m_event_reactor), std::addressof(ptp_object_heap), m_link.GetDevice(), std::addressof(m_event_queue), m_entries, m_snapshot_path))) {
+                        std::fprintf(stderr, "failed to initialize the responder\n");
+                        return;
+                    }
+
+                    sphaira::thread::OpenWorkerPool();
+
+                    ON_SCOPE_EXIT {
+                        sphaira::thread::CloseWorkerPool();
+                        ptp_responder.Finalize();
+                    };
+
+                    ptp_responder.LoopProcess();
+                }
+
+                void ProcessEvent() override {
+                    m_event_reactor.SetResult(haze::ResultStopRequested());
+                }
+        };
+
+        /* The pc side. Containers are written and read with the same builder and parser the responder uses. */
+        class Initiator {
+            private:
+                Transport *m_transport;
+                u32 m_trans_id;
+                PtpUsbBulkContainer m_request;
+            public:
+                explicit Initiator(Transport *transport) : m_transport(transport), m_trans_id(), m_request() { /* ... */ }
+
+                Result SendCommand(PtpOperationCode code, std::initializer_list<u32> params = {}) {
+                    m_request = { .length = static_cast<u32>(PtpUsbBulkHeaderLength + params.size() * sizeof(u32)), .type = PtpUsbBulkContainerType_Command, .code = code, .trans_id = ++m_trans_id };
+
+                    PtpDataBuilder db(m_transport);
+                    R_TRY(db.Add(m_request));
+                    for (const u32 param : params) {
+                        R_TRY(db.Add(param));
+                    }
+
+                    R_RETURN(db.Commit());
+                }
+
+                template <typename F>
+                Result SendData(u32 data_size, F &&func) {
+                    PtpDataBuilder db(m_transport);
+                    R_TRY(db.AddDataHeader(m_request, data_size));
+                    R_TRY(func(db));
+                    R_RETURN(db.Commit());
+                }
+
+                /* Hands each received piece of the data phase to func, and returns the size of the data. */
+                template <typename F>
+                Result ReceiveData(u64 *out_size, F &&func) {
+                    PtpDataParser dp(m_transport);
+
+                    PtpUsbBulkContainer header;
+                    R_TRY(dp.Read(std::addressof(header)));
+                    R_UNLESS(header.type == PtpUsbBulkContainerType_Data, haze::ResultUnknownRequestType());
+                    R_UNLESS(header.trans_id == m_trans_id,               haze::ResultOperationNotSupported());
+
+                    *out_size = 0;
+                    while (true) {
+                        u8 *data;
+                        u32 size;
+                        R_TRY(dp.AcquireBuffer(std::addressof(data), std::addressof(size)));
+
+                        if (data == nullptr) {
+                            break;
+                        }
+
+                        func(data, size);
+                        *out_size += size;
+                        dp.ReleaseBuffer(data);
+                    }
+
+                    R_SUCCEED();
+                }
+
+                Result ReceiveData(std::vector<u8> *out) {
+                    out->clear();
+
+                    u64 size;
+                    R_RETURN(this->ReceiveData(std::addressof(size), [out](const u8 *data, u32 size) { out->insert(out->end(), data, data + size); }));
+                }
+
+                Result ReceiveResponse(u32 *out_params = nullptr, u32 max_params = 0) {
+                    PtpDataParser dp(m_transport);
+
+                    PtpUsbBulkContainer header;
+                    R_TRY(dp.Read(std::addressof(header)));
+                    R_UNLESS(header.type == PtpUsbBulkContainerType_Response, haze::ResultUnknownRequestType());
+                    R_UNLESS(header.trans_id == m_trans_id,                   haze::ResultOperationNotSupported());
+
+                    const u32 param_count = std::min<u32>((header.length - PtpUsbBulkHeaderLength) / sizeof(u32), max_params);
+                    for (u32 i = 0; i < param_count; i++) {
+                        R_TRY(dp.Read(out_params + i));
+                    }
+
+                    R_TRY(dp.Finalize());
+
+                    if (header.code != PtpResponseCode_Ok) {
+                        std::fprintf(stderr, "operation %#x failed with %#x\n", m_request.code, header.code);
+                        R_THROW(haze::ResultOperationNotSupported());
+                    }
+
+                    R_SUCCEED();
+                }
+        };
+
+        struct ObjectInfo {
+            u32 handle;
+            u16 format;
+            u32 size;
+            std::string name;
+        };
+
+        u32 ReadU32(const std::vector<u8> &data, size_t offset) {
+            u32 value = 0;
+            if (offset + sizeof(value) <= data.size()) {
+                std::memcpy(std::addressof(value), data.data() + offset, sizeof(value));
+            }
+            return value;
+        }
+
+        std::string ReadString(const std::vector<u8> &data, size_t offset) {
+            std::string out;
+            if (offset >= data.size()) {
+                return out;
+            }
+
+            const u8 len = data[offset];
+            for (u32 i = 0; i < len && offset + 1 + (i + 1) * sizeof(u16) <= data.size(); i++) {
+                u16 c;
+                std::memcpy(std::addressof(c), data.data() + offset + 1 + i * sizeof(u16), sizeof(c));
+                if (c == 0) {
+                    break;
+                }
+
+                /* Names here are expected to be ascii. */
+                out.push_back(c < 0x80 ? static_cast<char>(c) : '?');
+            }
+            return out;
+        }
+
+        double ElapsedSeconds(u64 start_tick) {
+            return static_cast<double>(armTicksToNs(armGetSystemTick() - start_tick)) / 1'000'000'000.0;
+        }
+
+        double MegabytesPerSecond(u64 size, double seconds) {
+            return seconds > 0 ? static_cast<double>(size) / (1024.0 * 1024.0) / seconds : 0;
+        }
+
+        Result GetObjectHandles(Initiator &initiator, u32 parent, std::vector<u32> *out) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_GetObjectHandles, { StorageId_DefaultStorage, PtpGetObjectHandles_AllFormats, parent }));
+
+            std::vector<u8> data;
+            R_TRY(initiator.ReceiveData(std::addressof(data)));
+            R_TRY(initiator.ReceiveResponse());
+
+            out->clear();
+            for (u32 i = 0; i < ReadU32(data, 0); i++) {
+                out->push_back(ReadU32(data, (i + 1) * sizeof(u32)));
+            }
+
+            R_SUCCEED();
+        }
+
+        Result GetObjectInfo(Initiator &initiator, u32 handle, ObjectInfo *out) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_GetObjectInfo, { handle }));
+
+            std::vector<u8> data;
+            R_TRY(initiator.ReceiveData(std::addressof(data)));
+            R_TRY(initiator.ReceiveResponse());
+
+            /* See the ObjectInfo dataset, the filename follows the fixed size fields. */
+            u16 format = 0;
+            if (data.size() >= 6) {
+                std::memcpy(std::addressof(format), data.data() + 4, sizeof(format));
+            }
+
+            *out = { .handle = handle, .format = format, .size = ReadU32(data, 8), .name = ReadString(data, 52) };
+            R_SUCCEED();
+        }
+
+        /* Lists every object below parent, depth first, in the order the responder hands them out. */
+        Result ListObjects(Initiator &initiator, u32 parent, const std::string &path, std::vector<ObjectInfo> *out) {
+            std::vector<u32> handles;
+            R_TRY(GetObjectHandles(initiator, parent, std::addressof(handles)));
+
+            for (const u32 handle : handles) {
+                ObjectInfo info;
+                R_TRY(GetObjectInfo(initiator, handle, std::addressof(info)));
+
+                info.name = path + "/" + info.name;
+                out->push_back(info);
+
+                if (info.format == PtpObjectFormatCode_Association) {
+                    R_TRY(ListObjects(initiator, handle, info.name, out));
+                }
+            }
+
+            R_SUCCEED();
+        }
+
+        template <typename F>
+        Result GetObject(Initiator &initiator, u32 handle, u64 *out_size, F &&func) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_GetObject, { handle }));
+            R_TRY(initiator.ReceiveData(out_size, func));
+            R_RETURN(initiator.ReceiveResponse());
+        }
+
+        /* Uploads are a counting pattern, so a bad write is easy to spot. */
+        u32 GetPatternWord(u32 offset) {
+            return offset / sizeof(u32);
+        }
+
+        Result SendObject(Initiator &initiator, const char *name, u32 size, u32 *out_handle) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_SendObjectInfo, { StorageId_DefaultStorage, PtpGetObjectHandles_RootParent }));
+
+            /* The ObjectInfo dataset, with only the fields the responder reads filled in. */
+            std::vector<u8> info(52);
+            const u16 format = PtpObjectFormatCode_Undefined;
+            std::memcpy(info.data() + 4, std::addressof(format), sizeof(format));
+            std::memcpy(info.data() + 8, std::addressof(size), sizeof(size));
+
+            const auto add_info = [&](PtpDataBuilder &db) -> Result {
+                R_TRY(db.AddBuffer(info.data(), info.size()));
+                R_TRY(db.AddString(name));
+                R_TRY(db.AddString(""));
+                R_TRY(db.AddString(""));
+                R_RETURN(db.AddString(""));
+            };
+
+            /* The builder counts the dataset before sending it, so its size is worked out the same way. */
+            const u32 info_size = info.size() + 1 + (std::strlen(name) + 1) * sizeof(u16) + 3;
+            R_TRY(initiator.SendData(info_size, add_info));
+
+            u32 params[3];
+            R_TRY(initiator.ReceiveResponse(params, 3));
+            *out_handle = params[2];
+
+            R_TRY(initiator.SendCommand(PtpOperationCode_SendObject));
+            R_TRY(initiator.SendData(size, [size](PtpDataBuilder &db) -> Result {
+                u32 pattern[4_KB / sizeof(u32)];
+                for (u32 offset = 0; offset < size; offset += sizeof(pattern)) {
+                    for (u32 i = 0; i < std::size(pattern); i++) {
+                        pattern[i] = GetPatternWord(offset + i * sizeof(u32));
+                    }
+                    R_TRY(db.AddBuffer(reinterpret_cast<const u8 *>(pattern), std::min<u32>(sizeof(pattern), size - offset)));
+                }
+                R_SUCCEED();
+            }));
+
+            R_RETURN(initiator.ReceiveResponse());
+        }
+
+        Result RenameObject(Initiator &initiator, u32 handle, const char *name) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_MtpSetObjectPropValue, { handle, PtpObjectPropertyCode_ObjectFileName }));
+            R_TRY(initiator.SendData((std::strlen(name) + 1) * sizeof(u16) + 1, [name](PtpDataBuilder &db) -> Result { R_RETURN(db.AddString(name)); }));
+            R_RETURN(initiator.ReceiveResponse());
+        }
+
+        Result RunSession(Initiator &initiator, u32 upload_size, std::vector<ObjectInfo> *out_objects) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_OpenSession, { 1 }));
+            R_TRY(initiator.ReceiveResponse());
+
+            /* Walk everything, timing how long the listing takes. */
+            u64 start_tick = armGetSystemTick();
+
+            std::vector<ObjectInfo> objects;
+            R_TRY(ListObjects(initiator, PtpGetObjectHandles_RootParent, "", std::addressof(objects)));
+
+            std::printf("listed %zu objects in %.3fs\n", objects.size(), ElapsedSeconds(start_tick));
+
+            /* A second listing is answered from the directory cache, and must come back in the same order. */
+            {
+                std::vector<ObjectInfo> cached_objects;
+                R_TRY(ListObjects(initiator, PtpGetObjectHandles_RootParent, "", std::addressof(cached_objects)));
+
+                bool same_order = cached_objects.size() == objects.size();
+                for (size_t i = 0; same_order && i < objects.size(); i++) {
+                    same_order = cached_objects[i].handle == objects[i].handle;
+                }
+
+                if (!same_order) {
+                    std::fprintf(stderr, "cached listing differs from the first\n");
+                    R_THROW(haze::ResultTransferFailed());
+                }
+            }
+
+            /* Download every file, in listing order, as a pc copying the folder would. */
+            start_tick = armGetSystemTick();
+
+            u64 total_size = 0;
+            u32 file_count = 0;
+            for (const auto &object : objects) {
+                if (object.format == PtpObjectFormatCode_Association) {
+                    continue;
+                }
+
+                u64 size;
+                R_TRY(GetObject(initiator, object.handle, std::addressof(size), [](const u8 *, u32) { /* ... */ }));
+
+                if (size != object.size && object.size != 0xFFFFFFFF) {
+                    std::fprintf(stderr, "%s: received %lu bytes, expected %u\n", object.name.c_str(), size, object.size);
+                }
+
+                total_size += size;
+                file_count++;
+            }
+
+            const double read_seconds = ElapsedSeconds(start_tick);
+            std::printf("read %u files, %lu bytes in %.3fs, %.1f MB/s\n", file_count, total_size, read_seconds, MegabytesPerSecond(total_size, read_seconds));
+
+            /* Upload a file, then remove it again. */
+            if (upload_size > 0) {
+                start_tick = armGetSystemTick();
+
+                u32 handle;
+                R_TRY(SendObject(initiator, "haze-host-upload.bin", upload_size, std::addressof(handle)));
+
+                const double write_seconds = ElapsedSeconds(start_tick);
+                std::printf("wrote %u bytes in %.3fs, %.1f MB/s\n", upload_size, write_seconds, MegabytesPerSecond(upload_size, write_seconds));
+
+                /* Read it back, checking every word landed where it was sent. */
+                u64 offset = 0, mismatches = 0, size;
+                R_TRY(GetObject(initiator, handle, std::addressof(size), [&](const u8 *data, u32 data_size) {
+                    for (u32 i = 0; i + sizeof(u32) <= data_size; i += sizeof(u32)) {
+                        u32 word;
+                        std::memcpy(std::addressof(word), data + i, sizeof(word));
+                        mismatches += word != GetPatternWord(offset + i);
+                    }
+                    offset += data_size;
+                }));
+
+                if (size != upload_size || mismatches != 0) {
+                    std::fprintf(stderr, "upload read back as %lu bytes with %lu bad words\n", size, mismatches);
+                    R_THROW(haze::ResultTransferFailed());
+                }
+
+                /* A change of case keeps the object, and its handle. */
+                ObjectInfo info;
+                R_TRY(RenameObject(initiator, handle, "HAZE-HOST-UPLOAD.bin"));
+                R_TRY(GetObjectInfo(initiator, handle, std::addressof(info)));
+
+                if (info.name != "HAZE-HOST-UPLOAD.bin") {
+                    std::fprintf(stderr, "upload was renamed to %s\n", info.name.c_str());
+                    R_THROW(haze::ResultTransferFailed());
+                }
+
+                R_TRY(initiator.SendCommand(PtpOperationCode_DeleteObject, { handle }));
+                R_TRY(initiator.ReceiveResponse());
+            }
+
+            R_TRY(initiator.SendCommand(PtpOperationCode_CloseSession));
+            R_TRY(initiator.ReceiveResponse());
+
+            *out_objects = std::move(objects);
+            R_SUCCEED();
+        }
+
+        /* A host reconnecting is restored from the snapshot, and must see the same handles as before. */
+        Result RunReconnect(Initiator &initiator, const std::vector<ObjectInfo> &objects) {
+            R_TRY(initiator.SendCommand(PtpOperationCode_OpenSession, { 1 }));
+            R_TRY(initiator.ReceiveResponse());
+
+            const u64 start_tick = armGetSystemTick();
+
+            std::vector<ObjectInfo> restored_objects;
+            R_TRY(ListObjects(initiator, PtpGetObjectHandles_RootParent, "", std::addressof(restored_objects)));
+
+            std::printf("listed %zu objects again in %.3fs\n", restored_objects.size(), ElapsedSeconds(start_tick));
+
+            bool same_handles = restored_objects.size() == objects.size();
+            for (size_t i = 0; same_handles && i < objects.size(); i++) {
+                same_handles = restored_objects[i].handle == objects[i].handle && restored_objects[i].name == objects[i].name && restored_objects[i].size == objects[i].size;
+            }
+
+            if (!same_handles) {
+                std::fprintf(stderr, "handles changed across sessions\n");
+                R_THROW(haze::ResultTransferFailed());
+            }
+
+            R_TRY(initiator.SendCommand(PtpOperationCode_CloseSession));
+            R_RETURN(initiator.ReceiveResponse());
+        }
+
+    }
+
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <folder> [upload MB] [link MB/s] [link latency us]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const u32 upload_size = argc > 2 ? std::strtoul(argv[2], nullptr, 0) * 1024 * 1024 : 0;
+
+    haze::LoopbackLinkModel model{};
+    model.bytes_per_second = argc > 3 ? std::strtoull(argv[3], nullptr, 0) * 1024 * 1024 : 0;
+    model.latency_ns       = argc > 4 ? std::strtoull(argv[4], nullptr, 0) * 1000 : 0;
+
+    haze::FsEntries entries;
+    entries.emplace_back(std::make_shared<haze::PosixFs>(argv[1]));
+
+    /* Kept outside the folder, so that saving it doesn't change what is being served. */
+    char snapshot_path[64];
+    std::snprintf(snapshot_path, sizeof(snapshot_path), "%s/haze-host-%d.bin", P_tmpdir, static_cast<int>(getpid()));
+    ON_SCOPE_EXIT { std::remove(snapshot_path); };
+
+    haze::Device device{entries, snapshot_path};
+    if (R_FAILED(device.Start(model))) {
+        std::fprintf(stderr, "failed to set up the loopback link\n");
+        return EXIT_FAILURE;
+    }
+
+    haze::Initiator initiator{device.GetHost()};
+    std::vector<haze::ObjectInfo> objects;
+    haze::Result rc = haze::RunSession(initiator, upload_size, std::addressof(objects));
+    if (R_SUCCEEDED(rc)) {
+        rc = haze::RunReconnect(initiator, objects);
+    }
+
+    device.Stop();
+
+    if (R_FAILED(rc)) {
+        std::fprintf(stderr, "session failed with %#x\n", rc.GetValue());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <switch.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <execinfo.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+    /* Matches the kernel's timeout result, which callers only check for failure. */
+    constexpr Result ResultTimedOut = MAKERESULT(1, 117);
+
+    long Futex(u32 *addr, int op, u32 val, const timespec *timeout = nullptr) {
+        return syscall(SYS_futex, addr, op, val, timeout, nullptr, 0);
+    }
+
+    timespec ToTimespec(u64 ns) {
+        return { .tv_sec = static_cast<time_t>(ns / 1'000'000'000), .tv_nsec = static_cast<long>(ns % 1'000'000'000) };
+    }
+
+    /* Waits on several objects at once are rare compared to the work between them, */
+    /* so every waitable object shares one lock, and every signal wakes every waiter to check again. */
+    std::mutex g_wait_mutex;
+    std::condition_variable g_wait_cond;
+
+    struct HostThread {
+        ThreadFunc entry;
+        void *arg;
+        std::thread thread;
+        bool exited;
+    };
+
+    /* Thread handles index this table, starting from 1 so that 0 stays invalid. */
+    std::vector<HostThread *> g_threads{nullptr};
+
+    HostThread *GetThread(Handle handle) {
+        std::scoped_lock lk{g_wait_mutex};
+        return g_threads[handle];
+    }
+
+    bool IsSignaledLocked(const Waiter &waiter) {
+        switch (waiter.type) {
+            case WaiterType_UEvent:
+                if (waiter.event->signaled) {
+                    if (waiter.event->auto_clear) {
+                        waiter.event->signaled = 0;
+                    }
+                    return true;
+                }
+                return false;
+            case WaiterType_Handle:
+                return g_threads[waiter.handle]->exited;
+        }
+
+        return false;
+    }
+
+}
+
+extern "C" {
+
+void svcBreak(u32 reason, u64 address, u64 size) {
+    std::fprintf(stderr, "svcBreak(%u, %#lx, %#lx)\n", reason, address, size);
+
+    void *frames[64];
+    backtrace_symbols_fd(frames, backtrace(frames, std::size(frames)), STDERR_FILENO);
+    std::abort();
+}
+
+Result svcGetInfo(u64 *out, u32 id0, Handle handle, u64 id1) {
+    switch (id0) {
+        case InfoType_CoreMask:        *out = (1ULL << std::max(1U, std::thread::hardware_concurrency())) - 1; break;
+        case InfoType_TotalMemorySize: *out = static_cast<u64>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE); break;
+        case InfoType_UsedMemorySize:
+            {
+                /* The resident size, from the second field of statm. */
+                unsigned long size = 0, resident = 0;
+                if (FILE *f = std::fopen("/proc/self/statm", "r"); f != nullptr) {
+                    std::fscanf(f, "%lu %lu", &size, &resident);
+                    std::fclose(f);
+                }
+                *out = static_cast<u64>(resident) * sysconf(_SC_PAGESIZE);
+            }
+            break;
+        default:                       *out = 0; break;
+    }
+
+    return 0;
+}
+
+Result svcSetThreadCoreMask(Handle handle, s32 preferred_core, u64 affinity_mask) {
+    /* Leave placement to the host scheduler. */
+    return 0;
+}
+
+void svcSleepThread(s64 nano) {
+    if (nano > 0) {
+        const timespec ts = ToTimespec(nano);
+        nanosleep(&ts, nullptr);
+    } else {
+        sched_yield();
+    }
+}
+
+/* Ticks are nanoseconds on the host. */
+u64 armGetSystemTick(void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<u64>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+u64 armTicksToNs(u64 tick) {
+    return tick;
+}
+
+u64 armNsToTicks(u64 ns) {
+    return ns;
+}
+
+Result threadCreate(Thread *t, ThreadFunc entry, void *arg, void *stack_mem, size_t stack_sz, int prio, int cpuid) {
+    std::scoped_lock lk{g_wait_mutex};
+
+    g_threads.push_back(new HostThread{ .entry = entry, .arg = arg, .thread = {}, .exited = false });
+    t->handle = g_threads.size() - 1;
+    return 0;
+}
+
+Result threadStart(Thread *t) {
+    HostThread *thread = GetThread(t->handle);
+
+    thread->thread = std::thread([thread] {
+        thread->entry(thread->arg);
+
+        std::scoped_lock lk{g_wait_mutex};
+        thread->exited = true;
+        g_wait_cond.notify_all();
+    });
+
+    return 0;
+}
+
+Result threadWaitForExit(Thread *t) {
+    HostThread *thread = GetThread(t->handle);
+    if (thread->thread.joinable()) {
+        thread->thread.join();
+    }
+
+    return 0;
+}
+
+Result threadClose(Thread *t) {
+    threadWaitForExit(t);
+
+    std::scoped_lock lk{g_wait_mutex};
+    delete g_threads[t->handle];
+    g_threads[t->handle] = nullptr;
+    return 0;
+}
+
+/* 0 is unlocked, 1 is locked, 2 is locked with waiters. */
+void mutexInit(Mutex *m) {
+    *m = 0;
+}
+
+void mutexLock(Mutex *m) {
+    std::atomic_ref<u32> state{*m};
+
+    u32 expected = 0;
+    if (state.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+        return;
+    }
+
+    while (state.exchange(2, std::memory_order_acquire) != 0) {
+        Futex(m, FUTEX_WAIT_PRIVATE, 2);
+    }
+}
+
+bool mutexTryLock(Mutex *m) {
+    u32 expected = 0;
+    return std::atomic_ref<u32>{*m}.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+}
+
+void mutexUnlock(Mutex *m) {
+    if (std::atomic_ref<u32>{*m}.exchange(0, std::memory_order_release) == 2) {
+        Futex(m, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+/* The sequence changes on every wake, so a waiter that saw the old value before unlocking can't miss one. */
+void condvarInit(CondVar *c) {
+    *c = 0;
+}
+
+Result condvarWaitTimeout(CondVar *c, Mutex *m, u64 timeout) {
+    const u32 seq = std::atomic_ref<u32>{*c}.load(std::memory_order_relaxed);
+
+    mutexUnlock(m);
+
+    long rc;
+    if (timeout == UINT64_MAX) {
+        rc = Futex(c, FUTEX_WAIT_PRIVATE, seq);
+    } else {
+        const timespec ts = ToTimespec(timeout);
+        rc = Futex(c, FUTEX_WAIT_PRIVATE, seq, &ts);
+    }
+    const bool timed_out = rc != 0 && errno == ETIMEDOUT;
+
+    mutexLock(m);
+    return timed_out ? ResultTimedOut : 0;
+}
+
+Result condvarWait(CondVar *c, Mutex *m) {
+    return condvarWaitTimeout(c, m, UINT64_MAX);
+}
+
+Result condvarWakeOne(CondVar *c) {
+    std::atomic_ref<u32>{*c}.fetch_add(1, std::memory_order_relaxed);
+    Futex(c, FUTEX_WAKE_PRIVATE, 1);
+    return 0;
+}
+
+Result condvarWakeAll(CondVar *c) {
+    std::atomic_ref<u32>{*c}.fetch_add(1, std::memory_order_relaxed);
+    Futex(c, FUTEX_WAKE_PRIVATE, INT_MAX);
+    return 0;
+}
+
+void ueventCreate(UEvent *e, bool auto_clear) {
+    std::scoped_lock lk{g_wait_mutex};
+    e->signaled   = 0;
+    e->auto_clear = auto_clear;
+}
+
+void ueventSignal(UEvent *e) {
+    std::scoped_lock lk{g_wait_mutex};
+    e->signaled = 1;
+    g_wait_cond.notify_all();
+}
+
+void ueventClear(UEvent *e) {
+    std::scoped_lock lk{g_wait_mutex};
+    e->signaled = 0;
+}
+
+Waiter waiterForUEvent(UEvent *e) {
+    Waiter waiter{};
+    waiter.type  = WaiterType_UEvent;
+    waiter.event = e;
+    return waiter;
+}
+
+Waiter waiterForHandle(Handle h) {
+    Waiter waiter{};
+    waiter.type   = WaiterType_Handle;
+    waiter.handle = h;
+    return waiter;
+}
+
+Result waitObjects(s32 *idx_out, const Waiter *objects, s32 num_objects, u64 timeout) {
+    std::unique_lock lk{g_wait_mutex};
+
+    const auto is_signaled = [&] {
+        for (s32 i = 0; i < num_objects; i++) {
+            if (IsSignaledLocked(objects[i])) {
+                if (idx_out != nullptr) {
+                    *idx_out = i;
+                }
+                return true;
+            }
+        }
+        return false;
+    };
+
+    if (timeout == UINT64_MAX) {
+        g_wait_cond.wait(lk, is_signaled);
+        return 0;
+    }
+
+    return g_wait_cond.wait_for(lk, std::chrono::nanoseconds(timeout), is_signaled) ? 0 : ResultTimedOut;
+}
+
+Result waitSingle(Waiter w, u64 timeout) {
+    return waitObjects(nullptr, &w, 1, timeout);
+}
+
+Result setsysInitialize(void) {
+    return 0;
+}
+
+void setsysExit(void) {
+    /* ... */
+}
+
+Result setsysGetSerialNumber(SetSysSerialNumber *out) {
+    std::memset(out, 0, sizeof(*out));
+    std::strcpy(out->number, "HOST00000000");
+    return 0;
+}
+
+Result setsysGetFirmwareVersion(SetSysFirmwareVersion *out) {
+    std::memset(out, 0, sizeof(*out));
+    std::strcpy(out->display_version, "host");
+    return 0;
+}
+
+}
@@ -49,6 +49,12 @@ typedef struct {
 
 typedef void(*Callback)(const CallbackData* data);
 
+typedef enum {
+    NotifyType_Created, // a file or folder was created
+    NotifyType_Removed, // a file or folder was removed
+    NotifyType_Changed, // a file was written to or resized
+} NotifyType;
+
 struct FileSystemProxyImpl {
     virtual const char* GetName() const = 0;
     virtual const char* GetDisplayName() const = 0;
@@ -74,13 +80,40 @@ struct FileSystemProxyImpl {
     virtual Result GetDirectoryEntryCount(FsDir *d, s64 *out_count) = 0;
     virtual void CloseDirectory(FsDir *d) = 0;
 
+    /* Returning false for a read also stops the next file in a folder being opened and read ahead of the pc asking for it. */
     virtual bool MultiThreadTransfer(s64 size, bool read) { return true; }
+
+    /* How many threads may call ReadFile on the same file at once when sending it to the pc, up to 4. */
+    /* More than 1 helps backends that handle several requests at a time, such as the sd card. */
+    virtual u32 GetReadThreadCount(s64 size) { return 1; }
+
+    /* How many threads may call WriteFile on the same file at once when receiving it from the pc, up to 4. */
+    /* Only used when the pc sends the size up front, as the writes may land out of order. */
+    virtual u32 GetWriteThreadCount(s64 size) { return 1; }
+
+    /* If not 0, data received from the pc is gathered so that WriteFile is called with this size at offsets aligned to it, */
+    /* apart from the end of the file. This helps sd cards, at the cost of a copy and a buffer of this size per write queued. */
+    /* Capped at 4MiB, and the buffers are kept while libhaze runs. */
+    virtual u32 GetWriteAlignment(s64 size) { return 0; }
+
+    /* When a folder was last changed, in any unit, which must change whenever an entry is added to, removed from or renamed in it. */
+    /* Lets a snapshot restore the folder listings the pc last saw. Returning false, the default, has every folder listed again. */
+    virtual bool GetModifiedTime(const char *path, u64 *out) { return false; }
 };
 
 using FsEntries = std::vector<std::shared_ptr<FileSystemProxyImpl>>;
 
 /* Callback is optional */
-bool Initialize(Callback callback, int prio, int cpuid, const FsEntries& entries, u16 vid = 0x057e, u16 pid = 0x201d);
+/* object_heap_budget caps the memory used to track files during a session, 0 picks a default. */
+/* snapshot_path is optional, eg "sdmc:/config/app/haze.bin". If set, the files seen in a session are */
+/* saved there on close and restored on open, so a reconnecting pc keeps the same object handles. */
+/* transfer_prio and transfer_core_mask configure the threads that read and write files, 0 allows every core. */
+bool Initialize(Callback callback, int prio, int cpuid, const FsEntries& entries, u16 vid = 0x057e, u16 pid = 0x201d, size_t object_heap_budget = 0, const char* snapshot_path = nullptr, int transfer_prio = 0x3B, u64 transfer_core_mask = 0);
 void Exit();
 
+/* Tells the host about a change made outside of mtp, so it doesn't need to refresh. */
+/* path is relative to the root of fs, eg "/switch/app.nro". */
+/* Returns false if haze isn't running or too many events are pending. */
+bool Notify(NotifyType type, const FileSystemProxyImpl* fs, const char* path);
+
 } // namespace haze
@@ -16,12 +16,21 @@
 #pragma once
 
 #include <haze/async_usb_server.hpp>
+#include <haze/cancel_token.hpp>
 #include <haze/common.hpp>
 #include <haze/device_properties.hpp>
 #include <haze/event_reactor.hpp>
 #include <haze/file_system_proxy.hpp>
+#include <haze/loopback_transport.hpp>
 #include <haze/ptp.hpp>
+#include <haze/ptp_directory_cache.hpp>
+#include <haze/ptp_event_queue.hpp>
 #include <haze/ptp_object_database.hpp>
 #include <haze/ptp_object_heap.hpp>
+#include <haze/ptp_object_prefetcher.hpp>
+#include <haze/ptp_object_snapshot.hpp>
 #include <haze/ptp_responder.hpp>
+#include <haze/ptp_string.hpp>
+#include <haze/transfer_tuner.hpp>
+#include <haze/transport.hpp>
 #include <haze/usb_session.hpp>
@@ -17,28 +17,85 @@
 
 #include <haze/common.hpp>
 #include <haze/event_reactor.hpp>
+#include <haze/transport.hpp>
+#include <haze/usb_session.hpp>
 
 namespace haze {
 
-    class AsyncUsbServer final {
+    class AsyncUsbServer final : public Transport, public EventConsumer {
+        public:
+            static constexpr u32 MaxReadUrbCount  = 4;
+            static constexpr u32 MaxWriteUrbCount = 8;
+            static constexpr u32 DefaultWriteUrbCount = 4;
+        private:
+            struct ReadSlot {
+                u8 *data;
+                u32 urb_id;
+                u32 size_transferred;
+                PacketState state;
+            };
+
+            struct WriteSlot {
+                u8 *data;
+                u32 urb_id;
+                PacketState state;
+            };
         private:
             EventReactor *m_reactor;
+            ReadSlot m_read_slots[MaxReadUrbCount];
+            u32 m_read_slot_count;
+            u32 m_read_slot_size;
+            u32 m_read_post_index;
+            u32 m_read_complete_index;
+            WriteSlot m_write_slots[MaxWriteUrbCount];
+            u32 m_write_slot_count;
+            u32 m_write_slot_size;
+            u32 m_write_acquire_index;
+            u32 m_interrupt_urb_id;
+            bool m_interrupt_pending;
         public:
-            constexpr explicit AsyncUsbServer() : m_reactor() { /* ... */ }
+            constexpr explicit AsyncUsbServer() : m_reactor(), m_read_slots(), m_read_slot_count(), m_read_slot_size(), m_read_post_index(), m_read_complete_index(), m_write_slots(), m_write_slot_count(), m_write_slot_size(), m_write_acquire_index(), m_interrupt_urb_id(), m_interrupt_pending() { /* ... */ }
 
-            Result Initialize(const UsbCommsInterfaceInfo *interface_info, u16 id_vendor, u16 id_product, EventReactor *reactor);
+            Result Initialize(const UsbCommsInterfaceInfo *interface_info, u16 id_vendor, u16 id_product, EventReactor *reactor, u32 read_urb_count = MaxReadUrbCount, u32 write_urb_count = DefaultWriteUrbCount);
             void Finalize();
         private:
-            Result TransferPacketImpl(bool read, void *page, u32 size, u32 *out_size_transferred) const;
+            Result WaitForConfigured() const;
+            Result WaitForTransfer(UsbSessionEndpoint ep, u32 urb_id, u32 *out_size_transferred);
+
+            /* Cancel and status requests arrive on the control endpoint, alongside bulk transfers. */
+            void ProcessEvent() override;
+            Result HandleClassRequest(const UsbSetupPacket &setup);
+
+            Result PostReadSlots();
+            void ResetReadSlots();
+
+            void LayoutWriteSlots(u32 count);
+            Result WaitWriteSlot(WriteSlot &slot);
+            void ResetWriteSlots();
         public:
-            Result ReadPacket(void *page, u32 size, u32 *out_size_transferred) const {
-                R_RETURN(this->TransferPacketImpl(true, page, size, out_size_transferred));
-            }
+            bool GetConfigured() const override;
 
-            Result WritePacket(void *page, u32 size) const {
-                u32 size_transferred;
-                R_RETURN(this->TransferPacketImpl(false, page, size, std::addressof(size_transferred)));
-            }
+            /* Bulk reads are pipelined: up to read_urb_count URBs are kept queued on the OUT endpoint, */
+            /* and completed packets are handed out in the order they were received. */
+            Result AcquireReadPacket(u8 **out_data, u32 *out_size) override;
+            void ReleaseReadPacket(const u8 *data) override;
+
+            u32 GetReadPacketSize() const override { return m_read_slot_size; }
+
+            /* Bulk writes are asynchronous: a buffer is acquired, filled and posted, and may be refilled */
+            /* once its URB completes. Up to write_urb_count buffers may be in flight at once. */
+            Result AcquireWriteBuffer(u8 **out_data) override;
+            Result PostWriteBuffer(u8 *data, u32 size) override;
+            void ReleaseWriteBuffer(const u8 *data) override;
+            Result WaitWriteComplete() override;
+
+            u32 GetWritePacketSize() const override { return m_write_slot_size; }
+
+            Result SetWritePacketCount(u32 count) override;
+            u32 GetWritePacketCount() const override { return m_write_slot_count; }
+
+            /* Interrupt packets are not waited on, as the host may not be polling the endpoint. */
+            Result SendInterruptPacket(const void *data, u32 size) override;
     };
 
 }
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+#include <atomic>
+
+namespace haze {
+
+    /* Aborts waits and transfers in progress. Any thread may cancel, and the first reason given is kept. */
+    class CancelToken {
+        private:
+            std::atomic<Result> m_result;
+            UEvent m_event;
+        public:
+            constexpr explicit CancelToken() : m_result(ResultSuccess()), m_event() { /* ... */ }
+
+            void Initialize() {
+                ueventCreate(std::addressof(m_event), false);
+                this->Reset();
+            }
+        public:
+            void Cancel(Result reason) {
+                Result expected = ResultSuccess();
+                if (!m_result.compare_exchange_strong(expected, reason)) {
+                    /* A reset supersedes a cancel not yet handled, as the host gave up waiting on it. */
+                    if (haze::ResultCancelled::Includes(expected) && haze::ResultDeviceReset::Includes(reason)) {
+                        m_result.compare_exchange_strong(expected, reason);
+                    }
+                }
+
+                ueventSignal(std::addressof(m_event));
+            }
+
+            void Reset() {
+                ueventClear(std::addressof(m_event));
+                m_result = ResultSuccess();
+            }
+
+            bool IsCancelled() const { return R_FAILED(m_result.load()); }
+            Result GetResult() const { return m_result.load(); }
+
+            /* Remains signaled until reset. */
+            Waiter GetWaiter() { return waiterForUEvent(std::addressof(m_event)); }
+    };
+
+}
@@ -15,10 +15,15 @@
  */
 #pragma once
 
+#include <haze/async_usb_server.hpp>
+#include <haze/cancel_token.hpp>
 #include <haze/event_reactor.hpp>
+#include <haze/ptp_event_queue.hpp>
 #include <haze/ptp_object_heap.hpp>
 #include <haze/ptp_responder.hpp>
 #include <haze/thread.hpp>
+#include <haze/threaded_file_transfer.hpp>
+#include <string>
 
 namespace haze {
 
@@ -30,44 +35,77 @@ namespace haze {
             const FsEntries m_entries;
             const u16 m_vid;
             const u16 m_pid;
+            const size_t m_object_heap_budget;
+            const std::string m_snapshot_path;
+            const int m_transfer_prio;
+            const u64 m_transfer_core_mask;
             Thread m_thread{};
             UEvent m_cancel_event{};
+            CancelToken m_cancel_token{};
             EventReactor m_event_reactor{};
+            PtpEventQueue m_event_queue{};
 
         public:
-            explicit ConsoleMainLoop(Callback callback, int prio, int cpuid, const FsEntries& entries, u16 vid = 0x057e, u16 pid = 0x201d)
-            : m_callback{callback}, m_prio{prio}, m_cpuid{cpuid}, m_entries{entries}, m_vid{vid}, m_pid{pid} {
+            explicit ConsoleMainLoop(Callback callback, int prio, int cpuid, const FsEntries& entries, u16 vid = 0x057e, u16 pid = 0x201d, size_t object_heap_budget = 0, const char *snapshot_path = nullptr, int transfer_prio = 0x3B, u64 transfer_core_mask = 0)
+            : m_callback{callback}, m_prio{prio}, m_cpuid{cpuid}, m_entries{entries}, m_vid{vid}, m_pid{pid}, m_object_heap_budget{object_heap_budget}, m_snapshot_path{snapshot_path != nullptr ? snapshot_path : ""}, m_transfer_prio{transfer_prio}, m_transfer_core_mask{transfer_core_mask} {
                 /* Create cancel event. */
                 ueventCreate(&m_cancel_event, false);
 
+                /* Create the queue of events for the host. */
+                m_event_queue.Initialize();
+
                 /* Clear the event reactor. */
+                m_event_reactor.Initialize();
                 m_event_reactor.SetResult(ResultSuccess());
                 m_event_reactor.AddConsumer(this, waiterForUEvent(&m_cancel_event));
 
+                /* Allow transfers to be aborted by the host, or by us on exit. */
+                m_cancel_token.Initialize();
+                m_event_reactor.SetCancelToken(std::addressof(m_cancel_token));
+
                 /* Create and start thread. */
                 sphaira::utils::CreateThread(&m_thread, thread_func, this, 1024*64);
                 threadStart(&m_thread);
             }
 
             ~ConsoleMainLoop() {
+                /* Abort any transfer in progress, which may not be waiting on the reactor. */
+                m_cancel_token.Cancel(haze::ResultStopRequested());
                 ueventSignal(&m_cancel_event);
                 threadWaitForExit(&m_thread);
                 threadClose(&m_thread);
             }
 
         public:
+            bool Notify(NotifyType type, const FileSystemProxyImpl *fs, const char *path) {
+                return m_event_queue.Push(type, fs, path);
+            }
+
             void RunApplication() {
                 /* Declare the object heap, to hold the database for an active session. */
-                PtpObjectHeap ptp_object_heap;
+                PtpObjectHeap ptp_object_heap{m_object_heap_budget};
+
+                /* Configure the USB transport. */
+                AsyncUsbServer usb_server;
+                usb_server.Initialize(std::addressof(MtpInterfaceInfo), m_vid, m_pid, std::addressof(m_event_reactor));
 
                 /* Configure the PTP responder. */
                 PtpResponder ptp_responder{m_callback};
-                ptp_responder.Initialize(std::addressof(m_event_reactor), std::addressof(ptp_object_heap), m_entries, m_vid, m_pid);
+                ptp_responder.Initialize(std::addressof(m_event_reactor), std::addressof(ptp_object_heap), std::addressof(usb_server), std::addressof(m_event_queue), m_entries, m_snapshot_path.empty() ? nullptr : m_snapshot_path.c_str());
+
+                /* Keep the transfer threads open while we run. Transfers create their own if this fails. */
+                sphaira::thread::OpenWorkerPool(m_transfer_prio, m_transfer_core_mask);
 
                 /* Ensure we maintain a clean state on exit. */
                 ON_SCOPE_EXIT {
+                    /* Close the transfer threads. */
+                    sphaira::thread::CloseWorkerPool();
+
                     /* Finalize the PTP responder. */
                     ptp_responder.Finalize();
+
+                    /* Finalize the USB transport. */
+                    usb_server.Finalize();
                 };
 
                 /* Begin processing requests. */
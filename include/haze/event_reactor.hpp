@@ -15,7 +15,9 @@
  */
 #pragma once
 
+#include <haze/cancel_token.hpp>
 #include <haze/common.hpp>
+#include <atomic>
 
 namespace haze {
 
@@ -30,23 +32,44 @@ namespace haze {
             EventConsumer *m_consumers[svc::ArgumentHandleCountMax];
             Waiter m_waiters[svc::ArgumentHandleCountMax];
             s32 m_num_wait_objects;
-            Result m_result;
+            std::atomic<Result> m_result;
+            CancelToken *m_cancel_token;
+            std::atomic<bool> m_serving;
+            UEvent m_serving_done_event;
         public:
-            constexpr explicit EventReactor() : m_consumers(), m_waiters(), m_num_wait_objects(), m_result(ResultSuccess()) { /* ... */ }
+            constexpr explicit EventReactor() : m_consumers(), m_waiters(), m_num_wait_objects(), m_result(ResultSuccess()), m_cancel_token(), m_serving(), m_serving_done_event() { /* ... */ }
+
+            void Initialize();
 
             bool AddConsumer(EventConsumer *consumer, Waiter waiter);
             void RemoveConsumer(EventConsumer *consumer);
         public:
             void SetResult(Result r) { m_result = r; }
-            Result GetResult() const { return m_result; }
+            Result GetResult() const { return m_result.load(); }
+
+            /* Once cancelled, every wait fails with the reason given until the token is reset. */
+            void SetCancelToken(CancelToken *token) { m_cancel_token = token; }
+            CancelToken *GetCancelToken() const { return m_cancel_token; }
         public:
             template <typename... Args> requires (sizeof...(Args) > 0)
             Result WaitFor(s32 *out_arg_waiter, Args &&... arg_waiters) {
                 const Waiter arg_waiter_array[] = { arg_waiters... };
-                return this->WaitForImpl(out_arg_waiter, arg_waiter_array, sizeof...(Args));
+                return this->WaitForImpl(out_arg_waiter, arg_waiter_array, sizeof...(Args), false);
+            }
+
+            /* Consumers are handled by whichever thread is waiting. A thread waiting on others which may wait too, */
+            /* such as transfer threads, serves them itself in the meantime, so that an event is neither left */
+            /* unhandled while the others are busy, nor handled by two threads at once. */
+            void BeginServing();
+            void EndServing();
+
+            template <typename... Args> requires (sizeof...(Args) > 0)
+            Result Serve(s32 *out_arg_waiter, Args &&... arg_waiters) {
+                const Waiter arg_waiter_array[] = { arg_waiters... };
+                return this->WaitForImpl(out_arg_waiter, arg_waiter_array, sizeof...(Args), true);
             }
         private:
-            Result WaitForImpl(s32 *out_arg_waiter, const Waiter *arg_waiters, s32 num_arg_waiters);
+            Result WaitForImpl(s32 *out_arg_waiter, const Waiter *arg_waiters, s32 num_arg_waiters, bool serving);
     };
 
 }
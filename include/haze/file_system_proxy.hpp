@@ -135,6 +135,18 @@ namespace haze {
             bool MultiThreadTransfer(s64 size, bool read) {
                 return m_filesystem->MultiThreadTransfer(size, read);
             }
+
+            u32 GetReadThreadCount(s64 size) {
+                return m_filesystem->GetReadThreadCount(size);
+            }
+
+            u32 GetWriteThreadCount(s64 size) {
+                return m_filesystem->GetWriteThreadCount(size);
+            }
+
+            u32 GetWriteAlignment(s64 size) {
+                return m_filesystem->GetWriteAlignment(size);
+            }
     };
 
 }
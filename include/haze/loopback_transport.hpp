@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+#include <haze/event_reactor.hpp>
+#include <haze/transport.hpp>
+#include <atomic>
+
+namespace haze {
+
+    /* Characteristics of an emulated link. A zero value disables the respective limit. */
+    struct LoopbackLinkModel {
+        u64 bytes_per_second;
+        u64 latency_ns;
+    };
+
+    /* One direction of a loopback link. Posted buffers are passed from a single producer to a single consumer */
+    /* without locking, and are read as if split into USB packets, so transfers end where they would on a real host. */
+    class LoopbackPipe {
+        public:
+            static constexpr u32 SegmentCount = 8;
+        private:
+            struct Segment {
+                const u8 *data;
+                u32 size;
+                u64 ready_tick;
+            };
+        private:
+            Segment m_segments[SegmentCount];
+            std::atomic<u32> m_write_count;
+            std::atomic<u32> m_read_count;
+            u32 m_read_offset;
+            u64 m_wire_tick;
+            LoopbackLinkModel m_model;
+            UEvent m_readable_event;
+            UEvent m_writable_event;
+        public:
+            constexpr explicit LoopbackPipe() : m_segments(), m_write_count(), m_read_count(), m_read_offset(), m_wire_tick(), m_model(), m_readable_event(), m_writable_event() { /* ... */ }
+
+            void Initialize(const LoopbackLinkModel &model);
+        public:
+            /* Producer. Posted data must remain valid until consumed. */
+            Result Push(EventReactor *reactor, const u8 *data, u32 size, u32 *out_sequence);
+            Result WaitConsumed(EventReactor *reactor, u32 sequence);
+            bool IsConsumed(u32 sequence) const;
+
+            /* Consumer. */
+            Result Read(EventReactor *reactor, u8 *data, u32 size, u32 *out_size);
+    };
+
+    class LoopbackTransport final : public Transport {
+        public:
+            static constexpr u32 PacketCount = 4;
+            static constexpr u32 PacketSize  = 1_MB;
+            static constexpr u32 MaxWritePacketCount = 8;
+            static constexpr u32 InterruptPacketSize = 1_KB;
+        private:
+            struct ReadSlot {
+                u8 *data;
+                PacketState state;
+            };
+
+            struct WriteSlot {
+                u8 *data;
+                u32 sequence;
+                PacketState state;
+            };
+        private:
+            EventReactor *m_reactor;
+            LoopbackPipe *m_read_pipe;
+            LoopbackPipe *m_write_pipe;
+            LoopbackPipe *m_interrupt_pipe;
+            u8 *m_buffer;
+            ReadSlot m_read_slots[PacketCount];
+            u32 m_read_index;
+            WriteSlot m_write_slots[MaxWritePacketCount];
+            u32 m_write_slot_count;
+            u32 m_write_slot_size;
+            u32 m_write_index;
+            u8 m_interrupt_buffer[InterruptPacketSize];
+            u32 m_interrupt_sequence;
+            bool m_interrupt_pending;
+        public:
+            constexpr explicit LoopbackTransport() : m_reactor(), m_read_pipe(), m_write_pipe(), m_interrupt_pipe(), m_buffer(), m_read_slots(), m_read_index(), m_write_slots(), m_write_slot_count(), m_write_slot_size(), m_write_index(), m_interrupt_buffer(), m_interrupt_sequence(), m_interrupt_pending() { /* ... */ }
+
+            /* A null reactor makes waits block the calling thread instead. */
+            Result Initialize(EventReactor *reactor, LoopbackPipe *read_pipe, LoopbackPipe *write_pipe, LoopbackPipe *interrupt_pipe);
+            void Finalize();
+        public:
+            bool GetConfigured() const override { return m_buffer != nullptr; }
+
+            Result AcquireReadPacket(u8 **out_data, u32 *out_size) override;
+            void ReleaseReadPacket(const u8 *data) override;
+
+            u32 GetReadPacketSize() const override { return PacketSize; }
+
+            Result AcquireWriteBuffer(u8 **out_data) override;
+            Result PostWriteBuffer(u8 *data, u32 size) override;
+            void ReleaseWriteBuffer(const u8 *data) override;
+            Result WaitWriteComplete() override;
+
+            u32 GetWritePacketSize() const override { return m_write_slot_size; }
+
+            Result SetWritePacketCount(u32 count) override;
+            u32 GetWritePacketCount() const override { return m_write_slot_count; }
+
+            Result SendInterruptPacket(const void *data, u32 size) override;
+
+            /* The host side of a link receives the device's interrupt packets here. */
+            Result ReceiveInterruptPacket(void *data, u32 size, u32 *out_size);
+    };
+
+    /* A connected device and host pair, for driving the PTP layer without USB hardware. */
+    class LoopbackLink {
+        private:
+            LoopbackPipe m_host_to_device_pipe;
+            LoopbackPipe m_device_to_host_pipe;
+            LoopbackPipe m_interrupt_pipe;
+            LoopbackTransport m_device;
+            LoopbackTransport m_host;
+        public:
+            constexpr explicit LoopbackLink() : m_host_to_device_pipe(), m_device_to_host_pipe(), m_interrupt_pipe(), m_device(), m_host() { /* ... */ }
+
+            /* The device side waits through its reactor, so that it can be stopped. The host side blocks. */
+            Result Initialize(EventReactor *device_reactor, const LoopbackLinkModel &model);
+            void Finalize();
+
+            LoopbackTransport *GetDevice() { return std::addressof(m_device); }
+            LoopbackTransport *GetHost() { return std::addressof(m_host); }
+    };
+
+}
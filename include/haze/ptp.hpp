@@ -24,6 +24,7 @@ namespace haze {
     constexpr inline u32 PtpUsbBulkSuperSpeedMaxPacketLength = 0x400;
     constexpr inline u32 PtpUsbBulkHeaderLength = 2 * sizeof(u32) + 2 * sizeof(u16);
     constexpr inline u32 PtpStringMaxLength = 255;
+    constexpr inline u32 PtpStringMaxUtf8Length = PtpStringMaxLength * 3;
 
     enum PtpUsbBulkContainerType : u16 {
         PtpUsbBulkContainerType_Undefined = 0x0000,
@@ -33,6 +34,16 @@ namespace haze {
         PtpUsbBulkContainerType_Event     = 0x0004,
     };
 
+    enum PtpUsbClassRequest : u8 {
+        PtpUsbClassRequest_Cancel               = 0x64,
+        PtpUsbClassRequest_GetExtendedEventData = 0x65,
+        PtpUsbClassRequest_DeviceReset          = 0x66,
+        PtpUsbClassRequest_GetDeviceStatus      = 0x67,
+    };
+
+    constexpr inline u8 PtpUsbClassRequestType   = 0x21;
+    constexpr inline u32 PtpUsbCancelRequestLength = sizeof(u16) + sizeof(u32);
+
     enum PtpOperationCode : u16 {
         PtpOperationCode_Undefined                    = 0x1000,
         PtpOperationCode_GetDeviceInfo                = 0x1001,
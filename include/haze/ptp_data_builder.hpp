@@ -15,20 +15,35 @@
  */
 #pragma once
 
-#include <haze/async_usb_server.hpp>
+#include <haze/transport.hpp>
 #include <haze/common.hpp>
 #include <haze/ptp.hpp>
+#include <haze/ptp_string.hpp>
 
 namespace haze {
 
     class PtpDataBuilder final {
         private:
-            AsyncUsbServer *m_server;
+            Transport *m_transport;
             u32 m_transmitted_size;
             u32 m_offset;
             u8 *m_data;
             bool m_disabled;
+            bool m_deferred;
         private:
+            Result EnsureBuffer() {
+                /* Acquire a buffer to write into, waiting for its previous transfer if required. */
+                if (m_data == nullptr) {
+                    R_TRY(m_transport->AcquireWriteBuffer(std::addressof(m_data)));
+                }
+
+                R_SUCCEED();
+            }
+
+            static u8 *GetPacketStart(u8 *data) {
+                return reinterpret_cast<u8 *>(util::AlignDown(reinterpret_cast<uintptr_t>(data), 4_KB));
+            }
+
             Result Flush() {
                 ON_SCOPE_EXIT {
                     m_transmitted_size += m_offset;
@@ -38,11 +53,22 @@ namespace haze {
                 /* If we're disabled, we have nothing to do. */
                 R_SUCCEED_IF(m_disabled);
 
-                /* Otherwise, we should write our buffered data. */
-                R_RETURN(m_server->WritePacket(m_data, m_offset));
+                /* Zero length packets still need a buffer to post. */
+                R_TRY(this->EnsureBuffer());
+
+                /* Otherwise, we should begin writing our buffered data. */
+                /* The buffer belongs to the server until its transfer completes. */
+                R_RETURN(m_transport->PostWriteBuffer(std::exchange(m_data, nullptr), m_offset));
             }
         public:
-            constexpr explicit PtpDataBuilder(void *data, AsyncUsbServer *server) : m_server(server),  m_transmitted_size(), m_offset(), m_data(static_cast<u8 *>(data)), m_disabled() { /* ... */ }
+            constexpr explicit PtpDataBuilder(Transport *transport) : m_transport(transport),  m_transmitted_size(), m_offset(), m_data(), m_disabled(), m_deferred() { /* ... */ }
+
+            ~PtpDataBuilder() {
+                /* Return any buffer we did not post. */
+                if (m_data != nullptr) {
+                    m_transport->ReleaseWriteBuffer(m_data);
+                }
+            }
 
             Result Commit() {
                 if (m_offset > 0) {
@@ -55,22 +81,39 @@ namespace haze {
                     R_TRY(this->Flush());
                 }
 
+                /* Wait for everything we posted to be sent. */
+                if (!m_disabled) {
+                    R_TRY(m_transport->WaitWriteComplete());
+                }
+
                 R_SUCCEED();
             }
 
             Result AddBuffer(const u8 *buffer, u32 count) {
+                const u32 packet_size = m_transport->GetWritePacketSize();
+
+                /* If deferred data outgrows the buffer, count the rest of it instead, see WriteVariableLengthData. */
+                if (m_deferred && m_offset + count > packet_size) {
+                    m_deferred = false;
+                    m_disabled = true;
+                }
+
                 while (count > 0) {
                     /* Calculate how many bytes we can write now. */
-                    const u32 write_size = std::min<u32>(count, haze::UsbBulkPacketBufferSize - m_offset);
+                    const u32 write_size = std::min<u32>(count, packet_size - m_offset);
 
                     /* Write this number of bytes. */
-                    std::memcpy(m_data + m_offset, buffer, write_size);
+                    if (!m_disabled) {
+                        R_TRY(this->EnsureBuffer());
+                        std::memcpy(m_data + m_offset, buffer, write_size);
+                    }
+
                     m_offset += write_size;
                     buffer += write_size;
                     count -= write_size;
 
                     /* If our buffer is full, flush it. */
-                    if (m_offset == haze::UsbBulkPacketBufferSize) {
+                    if (m_offset == packet_size && !m_deferred) {
                         R_TRY(this->Flush());
                     }
                 }
@@ -78,6 +121,33 @@ namespace haze {
                 R_SUCCEED();
             }
 
+            /* Zero-copy writes. The unused part of the current buffer, or a fresh buffer, is handed out to be filled in place. */
+            Result AcquireBuffer(u8 **out_data, u32 *out_size) {
+                /* Only a header may precede the handed out part, see PostBuffer. */
+                HAZE_ASSERT(!m_disabled && m_offset < 4_KB);
+
+                R_TRY(this->EnsureBuffer());
+
+                *out_data = std::exchange(m_data, nullptr) + m_offset;
+                *out_size = m_transport->GetWritePacketSize() - m_offset;
+
+                m_offset = 0;
+                R_SUCCEED();
+            }
+
+            Result PostBuffer(u8 *data, u32 size) {
+                /* Write buffers are page aligned, so anything written before the handed out part is recovered here. */
+                u8 * const packet = GetPacketStart(data);
+                const u32 packet_size = static_cast<u32>(data - packet) + size;
+
+                m_transmitted_size += packet_size;
+                R_RETURN(m_transport->PostWriteBuffer(packet, packet_size));
+            }
+
+            void ReleaseBuffer(u8 *data) {
+                m_transport->ReleaseWriteBuffer(GetPacketStart(data));
+            }
+
             template <typename T>
             Result Add(T value) {
                 u8 bytes[sizeof(T)];
@@ -109,26 +179,37 @@ namespace haze {
             Result WriteVariableLengthData(PtpUsbBulkContainer &request, F &&func) {
                 HAZE_ASSERT(m_offset == 0 && m_transmitted_size == 0);
 
-                /* Declare how many bytes the data will require to write. */
-                u32 data_size = 0;
-                {
-                    /* Temporarily disable writing to calculate the size.*/
-                    m_disabled = true;
+                /* On exit, make sure writing is enabled again. */
+                ON_SCOPE_EXIT {
+                    m_deferred = false;
+                    m_disabled = false;
+                };
 
-                    ON_SCOPE_EXIT {
-                        /* Report how many bytes were required. */
-                        data_size = m_transmitted_size;
+                /* Write the header with a placeholder length, and try to fit the data behind it in the same buffer. */
+                R_TRY(this->EnsureBuffer());
+                R_TRY(this->AddDataHeader(request, 0));
 
-                        /* On exit, enable writing and reset sizes. */
-                        m_transmitted_size = 0;
-                        m_disabled = false;
-                        m_offset = 0;
-                    };
+                m_deferred = true;
+                R_TRY(func());
+
+                if (m_deferred) {
+                    /* Everything fit, so patch the real length into the header and send it. */
+                    m_deferred = false;
+
+                    const u32 container_length = m_offset;
+                    std::memcpy(m_data, std::addressof(container_length), sizeof(container_length));
 
-                    R_TRY(func());
-                    R_TRY(this->Commit());
+                    R_RETURN(this->Commit());
                 }
 
+                /* The data did not fit, and was counted from where it outgrew the buffer. */
+                const u32 data_size = m_transmitted_size + m_offset - PtpUsbBulkHeaderLength;
+
+                /* Reset sizes and enable writing. */
+                m_transmitted_size = 0;
+                m_disabled = false;
+                m_offset = 0;
+
                 /* Actually copy and write the data. */
                 R_TRY(this->AddDataHeader(request, data_size));
                 R_TRY(func());
@@ -138,20 +219,17 @@ namespace haze {
                 R_SUCCEED();
             }
 
-            template <typename T>
-            Result AddString(const T *str) {
+            Result AddString(const char *str) {
                 /* Use one less than the maximum string length for maximum length with null terminator. */
-                const u8 len = static_cast<u8>(std::min<s32>(util::Strlen(str), PtpStringMaxLength - 1));
+                u16 chars[PtpStringMaxLength];
+                const u8 len = static_cast<u8>(ConvertUtf8ToPtpString(chars, PtpStringMaxLength - 1, str));
 
                 if (len > 0) {
                     /* Length is padded by null terminator for non-empty strings. */
-                    R_TRY(this->Add<u8>(len + 1));
+                    chars[len] = 0;
 
-                    for (size_t i = 0; i < len; i++) {
-                        R_TRY(this->Add<u16>(str[i]));
-                    }
-
-                    R_TRY(this->Add<u16>(0));
+                    R_TRY(this->Add<u8>(len + 1));
+                    R_TRY(this->AddBuffer(reinterpret_cast<const u8 *>(chars), (len + 1) * sizeof(u16)));
                 } else {
                     R_TRY(this->Add<u8>(len));
                 }
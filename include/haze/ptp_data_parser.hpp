@@ -15,38 +15,56 @@
  */
 #pragma once
 
-#include <haze/async_usb_server.hpp>
+#include <haze/transport.hpp>
 #include <haze/common.hpp>
 #include <haze/ptp.hpp>
+#include <haze/ptp_string.hpp>
 
 namespace haze {
 
     class PtpDataParser final {
         private:
-            AsyncUsbServer *m_server;
+            Transport *m_transport;
             u32 m_received_size;
             u32 m_offset;
             u8 *m_data;
             bool m_eot;
         private:
+            void ReleasePacket() {
+                /* Return the packet we hold to the server, so that it can be queued again. */
+                if (m_data != nullptr) {
+                    m_transport->ReleaseReadPacket(m_data);
+                    m_data = nullptr;
+                }
+            }
+
             Result Flush() {
                 R_UNLESS(!m_eot, haze::ResultEndOfTransmission());
 
+                this->ReleasePacket();
+
                 m_received_size = 0;
                 m_offset = 0;
 
                 ON_SCOPE_EXIT {
-                    /* End of transmission occurs when receiving a bulk transfer less than the buffer size. */
+                    /* End of transmission occurs when receiving a bulk transfer less than the packet size. */
                     /* PTP uses zero-length termination, so zero is a possible size to receive. */
-                    m_eot = m_received_size < haze::UsbBulkPacketBufferSize;
+                    m_eot = m_received_size < m_transport->GetReadPacketSize();
                 };
 
-                R_RETURN(m_server->ReadPacket(m_data, haze::UsbBulkPacketBufferSize, std::addressof(m_received_size)));
+                R_RETURN(m_transport->AcquireReadPacket(std::addressof(m_data), std::addressof(m_received_size)));
             }
         public:
-            constexpr explicit PtpDataParser(void *data, AsyncUsbServer *server) : m_server(server), m_received_size(), m_offset(), m_data(static_cast<u8 *>(data)), m_eot() { /* ... */ }
+            constexpr explicit PtpDataParser(Transport *transport) : m_transport(transport), m_received_size(), m_offset(), m_data(), m_eot() { /* ... */ }
+
+            ~PtpDataParser() {
+                this->ReleasePacket();
+            }
 
             Result Finalize() {
+                /* Once the transmission completes, the last packet is no longer needed. */
+                ON_SCOPE_EXIT { this->ReleasePacket(); };
+
                 /* Read until the transmission completes. */
                 while (true) {
                     Result rc = this->Flush();
@@ -78,6 +96,32 @@ namespace haze {
                 R_SUCCEED();
             }
 
+            /* Zero-copy reads. The unread part of the current packet, or the next packet, is handed out */
+            /* and becomes the caller's to release. An empty buffer is handed out at the end of the transmission. */
+            Result AcquireBuffer(u8 **out_data, u32 *out_size) {
+                if (m_offset == m_received_size) {
+                    /* Nothing more will arrive after the end of the transmission. */
+                    if (m_eot) {
+                        *out_data = nullptr;
+                        *out_size = 0;
+                        R_SUCCEED();
+                    }
+
+                    R_TRY(this->Flush());
+                }
+
+                *out_data = std::exchange(m_data, nullptr) + m_offset;
+                *out_size = m_received_size - m_offset;
+
+                m_offset = m_received_size;
+                R_SUCCEED();
+            }
+
+            void ReleaseBuffer(const u8 *data) {
+                /* Read packets are page aligned, so the start of the packet is recovered from any pointer into it. */
+                m_transport->ReleaseReadPacket(reinterpret_cast<const u8 *>(util::AlignDown(reinterpret_cast<uintptr_t>(data), 4_KB)));
+            }
+
             template <typename T>
             Result Read(T *out_t) {
                 u32 read_count;
@@ -90,22 +134,19 @@ namespace haze {
                 R_SUCCEED();
             }
 
-            /* NOTE: out_string must contain room for 256 bytes. */
+            /* NOTE: out_string must contain room for PtpStringMaxUtf8Length + 1 bytes. */
             /* The result will be null-terminated on successful completion. */
             Result ReadString(char *out_string) {
                 u8 len;
                 R_TRY(this->Read(std::addressof(len)));
 
-                /* Read characters one by one. */
-                for (size_t i = 0; i < len; i++) {
-                    u16 chr;
-                    R_TRY(this->Read(std::addressof(chr)));
-
-                    *out_string++ = static_cast<char>(chr);
-                }
+                /* Read all characters at once. */
+                u16 chars[PtpStringMaxLength];
+                u32 read_count;
+                R_TRY(this->ReadBuffer(reinterpret_cast<u8 *>(chars), len * sizeof(u16), std::addressof(read_count)));
 
-                /* Write null terminator. */
-                *out_string++ = '\x00';
+                /* Convert to UTF-8, and write null terminator. */
+                ConvertPtpStringToUtf8(out_string, PtpStringMaxUtf8Length + 1, chars, len);
 
                 R_SUCCEED();
             }
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+#include <haze/ptp_object_database.hpp>
+
+namespace haze {
+
+    /* Recently enumerated directories, so that a host browsing back and forth is served from memory. */
+    /* A listing is valid while its directory's generation is unchanged, which registering or unregistering */
+    /* a child bumps. Changes made outside of mtp are picked up once the listing reaches its maximum age. */
+    /* The listing itself is the directory's children in the object database. */
+    class PtpDirectoryCache {
+        private:
+            static constexpr size_t NumEntries = 16;
+            static constexpr u64 MaxEntryAgeNs = 10'000'000'000ULL;
+        private:
+            struct Entry {
+                u32 object_id;
+                u32 generation;
+                u64 created_tick;
+                u64 used_tick;
+                bool valid;
+            };
+        private:
+            Entry m_entries[NumEntries];
+        public:
+            constexpr explicit PtpDirectoryCache() : m_entries() { /* ... */ }
+
+            void Initialize();
+            void Finalize();
+        public:
+            bool Find(const PtpObject *directory);
+            void Store(const PtpObject *directory);
+
+            /* Whether Find would succeed, without marking the listing as used. */
+            bool Contains(const PtpObject *directory) const;
+        private:
+            static bool IsEntryCurrent(const Entry &entry, const PtpObject *directory, u64 tick);
+    };
+
+}
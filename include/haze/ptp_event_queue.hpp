@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+
+namespace haze {
+
+    struct PtpEvent {
+        NotifyType type;
+        const FileSystemProxyImpl *fs;
+        u32 object_id;
+        char path[FS_MAX_PATH];
+    };
+
+    /* Changes to be reported to the host, posted from any thread. */
+    /* The responder drains this onto the interrupt endpoint between requests. */
+    class PtpEventQueue {
+        public:
+            static constexpr size_t MaxEvents = 64;
+        private:
+            Mutex m_mutex;
+            UEvent m_event;
+            size_t m_read_index;
+            size_t m_count;
+            PtpEvent m_events[MaxEvents];
+        public:
+            constexpr explicit PtpEventQueue() : m_mutex(), m_event(), m_read_index(), m_count(), m_events() { /* ... */ }
+
+            void Initialize();
+        public:
+            /* Events naming a path relative to the root of a filesystem. */
+            bool Push(NotifyType type, const FileSystemProxyImpl *fs, const char *path);
+
+            /* Events naming an object which is already in the database. */
+            bool Push(NotifyType type, u32 object_id);
+
+            bool Peek(PtpEvent *out_event);
+            void Pop();
+            void Clear();
+
+            Waiter GetWaiter() { return waiterForUEvent(std::addressof(m_event)); }
+        private:
+            bool PushImpl(const PtpEvent &event);
+    };
+
+}
@@ -23,87 +23,224 @@ namespace haze {
 
     struct PtpObject {
         public:
-            util::IntrusiveRedBlackTreeNode m_name_node;
-            util::IntrusiveRedBlackTreeNode m_object_id_node;
             u32 m_parent_id;
             u32 m_object_id;
             u32 m_storage_id;
+            u32 m_name_hash;
+            u32 m_generation;
+            PtpObject *m_prev_sibling;
+            PtpObject *m_next_sibling;
+            s64 m_file_size;
+            u8 m_entry_type;
+            bool m_has_cached_info;
+            bool m_listed;
             char m_name[];
         public:
-            const char *GetName()  const { return m_name; }
-            u32 GetParentId()      const { return m_parent_id; }
-            u32 GetObjectId()      const { return m_object_id; }
-            u32 GetStorageId()      const { return m_storage_id; }
+            /* Only the last path component is stored. Full paths are built from the parent links. */
+            const char *GetBaseName() const { return m_name; }
+            u32 GetParentId()         const { return m_parent_id; }
+            u32 GetObjectId()         const { return m_object_id; }
+            u32 GetStorageId()        const { return m_storage_id; }
+            u32 GetNameHash()         const { return m_name_hash; }
+
+            /* Changes whenever a child is registered or unregistered. */
+            u32 GetGeneration()       const { return m_generation; }
+            void BumpGeneration()           { m_generation++; }
+
+            /* Registered objects with the same parent are linked together, see PtpObjectDatabase::GetFirstChild. */
+            PtpObject *GetNextSibling() const { return m_next_sibling; }
+
+            /* Set while enumerating the parent, for each child still found on the filesystem. */
+            bool GetIsListed()      const { return m_listed; }
+            void SetIsListed(bool listed) { m_listed = listed; }
         public:
             bool GetIsRegistered() const { return m_object_id != 0; }
             void Register(u32 object_id) { m_object_id = object_id; }
             void Unregister()            { m_object_id = 0; }
         public:
-            struct NameComparator {
-                struct RedBlackKeyType {
-                    const char *m_name;
+            /* Type and size of the object, as last seen in a directory listing or left by our own writes. */
+            bool GetCachedInfo(FsDirEntryType *out_entry_type, s64 *out_size) const {
+                if (!m_has_cached_info) {
+                    return false;
+                }
 
-                    constexpr RedBlackKeyType(const char *name) : m_name(name) { /* ... */ }
+                *out_entry_type = static_cast<FsDirEntryType>(m_entry_type);
+                *out_size       = m_file_size;
+                return true;
+            }
 
-                    constexpr const char *GetName() const {
-                        return m_name;
-                    }
-                };
+            void SetCachedInfo(FsDirEntryType entry_type, s64 size) {
+                m_entry_type      = entry_type;
+                m_file_size       = entry_type == FsDirEntryType_Dir ? 0 : size;
+                m_has_cached_info = true;
+            }
 
-                template<typename T> requires (std::same_as<T, PtpObject> || std::same_as<T, RedBlackKeyType>)
-                static constexpr int Compare(const T &lhs, const PtpObject &rhs) {
-                    /* All SD card filesystems supported by fs are case-insensitive and case-preserving. */
-                    /* Account for that in collation here. */
-                    return strcasecmp(lhs.GetName(), rhs.GetName());
-                }
+            void InvalidateCachedInfo() { m_has_cached_info = false; }
+    };
+
+    /* Table of registered objects, indexed directly by object ID. */
+    /* IDs are handed out sequentially from 1, so they are stored in fixed size chunks found with a shift. */
+    /* Storage roots use reserved IDs at the top of the range, and live in a small side table instead. */
+    /* Each slot also heads the list of its children. As the list belongs to the ID rather than the object, */
+    /* children survive their parent being re-registered under the same ID, and may be registered first. */
+    class PtpObjectIdTable {
+        private:
+            static constexpr u32 ChunkShift        = 10;
+            static constexpr u32 ChunkEntries      = 1u << ChunkShift;
+            static constexpr u32 InitialChunkCount = 16;
+            static constexpr u32 InitialRootCount  = 8;
+            static constexpr u32 RootObjectIdBase  = 0x80000000;
+        private:
+            struct Slot {
+                PtpObject *object;
+                PtpObject *first_child;
+                PtpObject *last_child;
+            };
+
+            struct Chunk {
+                Slot slots[ChunkEntries];
+            };
+
+            struct RootEntry {
+                u32 object_id;
+                Slot slot;
             };
+        private:
+            Chunk **m_chunks;
+            u32 m_chunk_count;
+            RootEntry *m_roots;
+            u32 m_root_count;
+            u32 m_root_capacity;
+        public:
+            constexpr explicit PtpObjectIdTable() : m_chunks(), m_chunk_count(), m_roots(), m_root_count(), m_root_capacity() { /* ... */ }
+
+            void Initialize();
+            void Finalize();
+        public:
+            PtpObject *Find(u32 object_id) const;
+            PtpObject *FindFirstChild(u32 object_id) const;
+            Result Insert(PtpObject *object);
+            void Erase(PtpObject *object);
 
-            struct ObjectIdComparator {
-                struct RedBlackKeyType {
-                    u32 m_object_id;
+            /* Children are kept in the order they were inserted, or last moved to the back. */
+            void MoveToBack(PtpObject *object);
+        private:
+            static constexpr bool IsRootObjectId(u32 object_id) {
+                return object_id >= RootObjectIdBase;
+            }
 
-                    constexpr RedBlackKeyType(u32 object_id) : m_object_id(object_id) { /* ... */ }
+            RootEntry *FindRootEntry(u32 object_id) const;
+            Slot *FindSlot(u32 object_id) const;
+            Result GetSlot(u32 object_id, Slot **out_slot);
 
-                    constexpr u32 GetObjectId() const {
-                        return m_object_id;
+            void LinkChild(Slot *parent_slot, PtpObject *object);
+            void UnlinkChild(Slot *parent_slot, PtpObject *object);
+        public:
+            template <typename F>
+            void ForEach(F f) const {
+                for (u32 i = 0; i < m_chunk_count; i++) {
+                    if (m_chunks[i] == nullptr) {
+                        continue;
                     }
-                };
 
-                template<typename T> requires (std::same_as<T, PtpObject> || std::same_as<T, RedBlackKeyType>)
-                static constexpr int Compare(const T &lhs, const PtpObject &rhs) {
-                    return lhs.GetObjectId() - rhs.GetObjectId();
+                    for (const Slot &slot : m_chunks[i]->slots) {
+                        if (slot.object != nullptr) {
+                            f(slot.object);
+                        }
+                    }
                 }
-            };
+
+                for (u32 i = 0; i < m_root_count; i++) {
+                    if (m_roots[i].slot.object != nullptr) {
+                        f(m_roots[i].slot.object);
+                    }
+                }
+            }
     };
 
-    class PtpObjectDatabase {
+    /* Open-addressed index of registered objects, keyed by parent and case-folded base name. */
+    /* Lookups compare the stored key before touching the object, and only compare names on a full match. */
+    class PtpObjectNameIndex {
+        private:
+            static constexpr u32 InitialCapacity = 4096;
+        private:
+            struct Entry {
+                u32 key;
+                PtpObject *object;
+            };
+        private:
+            Entry *m_entries;
+            u32 m_capacity;
+            u32 m_count;
+        public:
+            constexpr explicit PtpObjectNameIndex() : m_entries(), m_capacity(), m_count() { /* ... */ }
+
+            void Initialize();
+            void Finalize();
+        public:
+            static u32 HashName(const char *name);
+
+            PtpObject *Find(u32 parent_id, const char *name, u32 name_hash) const;
+            Result Insert(PtpObject *object);
+            void Erase(PtpObject *object);
         private:
-            using ObjectNameTreeTraits = util::IntrusiveRedBlackTreeMemberTraitsDeferredAssert<&PtpObject::m_name_node>;
-            using ObjectNameTree       = ObjectNameTreeTraits::TreeType<PtpObject::NameComparator>;
+            static constexpr u32 MakeKey(u32 parent_id, u32 name_hash) {
+                return name_hash ^ (parent_id * 0x9E3779B9);
+            }
 
-            using ObjectIdTreeTraits   = util::IntrusiveRedBlackTreeMemberTraitsDeferredAssert<&PtpObject::m_object_id_node>;
-            using ObjectIdTree         = ObjectIdTreeTraits::TreeType<PtpObject::ObjectIdComparator>;
+            constexpr u32 GetHomeIndex(u32 key) const {
+                return key & (m_capacity - 1);
+            }
 
+            bool Grow();
+    };
+
+    class PtpObjectDatabase {
+        private:
             PtpObjectHeap *m_object_heap;
-            ObjectNameTree m_name_tree;
-            ObjectIdTree m_object_id_tree;
+            PtpObjectNameIndex m_name_index;
+            PtpObjectIdTable m_id_table;
             u32 m_next_object_id;
         public:
-            constexpr explicit PtpObjectDatabase() : m_object_heap(), m_name_tree(), m_object_id_tree(), m_next_object_id() { /* ... */ }
+            constexpr explicit PtpObjectDatabase() : m_object_heap(), m_name_index(), m_id_table(), m_next_object_id() { /* ... */ }
 
             void Initialize(PtpObjectHeap *object_heap);
             void Finalize();
         public:
             /* Object database API. */
-            Result CreateOrFindObject(const char *parent_name, const char *name, u32 parent_id, u32 storage_id, PtpObject **out_object);
-            void RegisterObject(PtpObject *object, u32 desired_id = 0);
+            Result CreateOrFindObject(const char *name, u32 parent_id, u32 storage_id, PtpObject **out_object);
+            Result RegisterObject(PtpObject *object, u32 desired_id = 0);
             void UnregisterObject(PtpObject *object);
             void DeleteObject(PtpObject *obj);
 
-            Result CreateAndRegisterObjectId(const char *parent_name, const char *name, u32 parent_id, u32 storage_id, u32 *out_object_id);
+            /* Deletes an object along with every registered object below it. */
+            void DeleteObjectTree(PtpObject *obj);
+
+            /* Replaces the name of an object with one differing only in case, which keeps its place in the name index. */
+            void SetObjectNameCase(PtpObject *obj, const char *name);
+
+            Result CreateAndRegisterObjectId(const char *name, u32 parent_id, u32 storage_id, u32 *out_object_id);
         public:
             PtpObject *GetObjectById(u32 object_id);
-            PtpObject *GetObjectByName(const char *name);
+            PtpObject *GetObjectByName(u32 parent_id, const char *name);
+            PtpObject *GetFirstChild(u32 object_id);
+
+            /* Moves an object behind its siblings, so that they can be kept in the order the filesystem lists them. */
+            void MoveObjectToBack(PtpObject *object);
+
+            /* Builds the full path of an object, as the storage root and every component below it. */
+            Result GetObjectPath(const PtpObject *object, char *out_path, size_t path_size);
+        public:
+            /* Used to save and restore the database across sessions. */
+            u32 GetNextObjectId() const { return m_next_object_id; }
+            void SetNextObjectId(u32 object_id) { m_next_object_id = object_id; }
+
+            template <typename F>
+            void ForEachObject(F f) const {
+                m_id_table.ForEach(f);
+            }
+        private:
+            void BumpParentGeneration(const PtpObject *object);
     };
 
 }
@@ -21,69 +21,123 @@ namespace haze {
 
     /* This simple linear allocator implementation allows us to rapidly reclaim the entire object graph. */
     /* This is critical for maintaining interactivity when a session is closed. */
+    /* Freed allocations are kept in per-size free lists, so objects deleted mid-session are reused. */
+    /* Memory is taken from the system in chunks as the session grows, up to the configured budget. */
     class PtpObjectHeap {
         private:
-            static constexpr size_t NumHeapBlocks = 2;
+            static constexpr size_t HeapChunkSize = 1_MB;
+
+            /* Size classes are exact multiples of the allocation alignment, up to the largest object we expect. */
+            static constexpr size_t SizeClassGranularity = alignof(u64);
+            static constexpr size_t NumSizeClasses       = 128;
+            static constexpr size_t MaxSizeClassSize     = SizeClassGranularity * NumSizeClasses;
+
+            struct FreeNode {
+                FreeNode *next;
+            };
+
+            /* Each chunk links to the one allocated before it, so they can all be released on finalize. */
+            struct HeapChunk {
+                HeapChunk *prev;
+            };
+
+            static constexpr size_t HeapChunkDataSize = HeapChunkSize - sizeof(HeapChunk);
         private:
-            void *m_heap_blocks[NumHeapBlocks];
+            HeapChunk *m_current_chunk;
             void *m_next_address;
-            u32 m_heap_block_size;
-            u32 m_current_heap_block;
+            size_t m_budget;
+            size_t m_total_size;
+            FreeNode *m_free_lists[NumSizeClasses];
+            size_t m_free_size;
         public:
-            constexpr explicit PtpObjectHeap() : m_heap_blocks(), m_next_address(), m_heap_block_size(), m_current_heap_block() { /* ... */ }
+            /* A budget of zero selects a default based on the memory available to the process. */
+            constexpr explicit PtpObjectHeap(size_t budget = 0) : m_current_chunk(), m_next_address(), m_budget(budget), m_total_size(), m_free_lists(), m_free_size() { /* ... */ }
 
             void Initialize();
             void Finalize();
         public:
             constexpr size_t GetTotalSize() const {
-                return m_heap_block_size * NumHeapBlocks;
+                return m_total_size;
             }
 
             constexpr size_t GetUsedSize() const {
-                return (m_heap_block_size * m_current_heap_block) + this->GetNextAddress() - this->GetFirstAddress();
+                return m_total_size - (this->GetCurrentChunkEnd() - this->GetNextAddress()) - m_free_size;
             }
         private:
+            bool AdvanceToNextChunk();
+
             constexpr u8 *GetNextAddress()  const { return static_cast<u8 *>(m_next_address); }
-            constexpr u8 *GetFirstAddress() const { return static_cast<u8 *>(m_heap_blocks[m_current_heap_block]); }
 
-            constexpr u8 *GetCurrentBlockEnd() const {
-                return this->GetFirstAddress() + m_heap_block_size;
+            constexpr u8 *GetCurrentChunkEnd() const {
+                return m_current_chunk != nullptr ? reinterpret_cast<u8 *>(m_current_chunk) + HeapChunkSize : nullptr;
             }
 
             constexpr bool AllocationIsPossible(size_t n) const {
-                return n <= m_heap_block_size;
+                return n <= HeapChunkDataSize;
             }
 
             constexpr bool AllocationIsSatisfyable(size_t n) const {
+                /* Check that we have a chunk at all. */
+                if (m_current_chunk == nullptr) {
+                    return false;
+                }
+
                 /* Check for overflow. */
                 if (!util::CanAddWithoutOverflow(reinterpret_cast<uintptr_t>(this->GetNextAddress()), n)) {
                     return false;
                 }
 
-                /* Check if we would exceed the size of the current block. */
-                if (this->GetNextAddress() + n > this->GetCurrentBlockEnd()) {
+                /* Check if we would exceed the size of the current chunk. */
+                if (this->GetNextAddress() + n > this->GetCurrentChunkEnd()) {
                     return false;
                 }
 
                 return true;
             }
 
-            constexpr bool AdvanceToNextBlock() {
-                if (m_current_heap_block < NumHeapBlocks - 1) {
-                    m_next_address = m_heap_blocks[++m_current_heap_block];
-                    return true;
-                }
-
-                return false;
-            }
-
-            constexpr void *AllocateFromCurrentBlock(size_t n) {
+            constexpr void *AllocateFromCurrentChunk(size_t n) {
                 void *result = this->GetNextAddress();
 
                 m_next_address = this->GetNextAddress() + n;
 
                 return result;
             }
+
+            static constexpr size_t GetSizeClassIndex(size_t n) {
+                return n / SizeClassGranularity - 1;
+            }
+
+            constexpr void PushFreeList(void *p, size_t n) {
+                FreeNode *node = static_cast<FreeNode *>(p);
+                FreeNode *&head = m_free_lists[GetSizeClassIndex(n)];
+
+                node->next = head;
+                head = node;
+                m_free_size += n;
+            }
+
+            constexpr void *AllocateFromFreeList(size_t n) {
+                /* Take the smallest free chunk that fits, starting from an exact fit. */
+                for (size_t i = GetSizeClassIndex(n); i < NumSizeClasses; i++) {
+                    FreeNode *node = m_free_lists[i];
+                    if (node == nullptr) {
+                        continue;
+                    }
+
+                    const size_t chunk_size = (i + 1) * SizeClassGranularity;
+                    m_free_lists[i] = node->next;
+                    m_free_size -= chunk_size;
+
+                    /* Return the unused tail of a larger chunk to its own size class. */
+                    if (chunk_size > n) {
+                        this->PushFreeList(reinterpret_cast<u8 *>(node) + n, chunk_size - n);
+                    }
+
+                    return node;
+                }
+
+                return nullptr;
+            }
         public:
             template <typename T = void>
             constexpr T *Allocate(size_t n) {
@@ -100,14 +154,21 @@ namespace haze {
                     return nullptr;
                 }
 
-                /* If the allocation is not satisfyable now, we might be able to satisfy it on the next block. */
-                /* However, if the next block would be empty, we won't be able to satisfy the request. */
-                if (!this->AllocationIsSatisfyable(n) && !this->AdvanceToNextBlock()) {
+                /* Prefer reusing memory from a deleted object. */
+                if (n != 0 && n <= MaxSizeClassSize) {
+                    if (void *p = this->AllocateFromFreeList(n); p != nullptr) {
+                        return static_cast<T *>(p);
+                    }
+                }
+
+                /* If the allocation is not satisfyable now, we might be able to satisfy it from a new chunk. */
+                /* However, if the budget is exhausted, we won't be able to satisfy the request. */
+                if (!this->AllocationIsSatisfyable(n) && !this->AdvanceToNextChunk()) {
                     return nullptr;
                 }
 
                 /* Allocate the memory. */
-                return static_cast<T *>(this->AllocateFromCurrentBlock(n));
+                return static_cast<T *>(this->AllocateFromCurrentChunk(n));
             }
 
             constexpr void Deallocate(void *p, size_t n) {
@@ -122,10 +183,13 @@ namespace haze {
                 /* If the pointer was the last allocation, return the memory to the heap. */
                 if (static_cast<u8 *>(p) + n == this->GetNextAddress()) {
                     m_next_address = this->GetNextAddress() - n;
+                    return;
                 }
 
-                /* Otherwise, do nothing. */
-                /* ... */
+                /* Otherwise, keep it for a later allocation of the same size class. */
+                if (n != 0 && n <= MaxSizeClassSize) {
+                    this->PushFreeList(p, n);
+                }
             }
     };
 
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+
+namespace haze {
+
+    /* Opens the file the host is likely to ask for next, and reads its start, on a thread of its own. */
+    /* Hosts copying a folder get each file as soon as the last one is done, so the guess is the next sibling. */
+    /* A guess the host doesn't ask for is thrown away, and is closed after a while so the file isn't kept open. */
+    class PtpObjectPrefetcher {
+        public:
+            /* At most this much of the file is read ahead. */
+            static constexpr size_t BufferSize = 1_MB;
+        private:
+            static constexpr size_t ReadSize = 256_KB;
+            static constexpr u64 MaxHoldNs = 2'000'000'000ULL;
+        private:
+            enum State {
+                State_Idle,
+                State_Pending,
+                State_Reading,
+                State_Ready,
+            };
+        private:
+            Thread m_thread;
+            Mutex m_mutex;
+            CondVar m_condvar;
+            FileSystemProxyImpl *m_fs;
+            u32 m_object_id;
+            State m_state;
+            FsFile m_file;
+            s64 m_file_size;
+            s64 m_data_size;
+            u8 *m_buffer;
+            u64 m_ready_tick;
+            bool m_file_open;
+            bool m_discard;
+            bool m_exit;
+            bool m_initialized;
+            char m_path[FS_MAX_PATH];
+        public:
+            constexpr explicit PtpObjectPrefetcher() : m_thread(), m_mutex(), m_condvar(), m_fs(), m_object_id(), m_state(), m_file(), m_file_size(), m_data_size(), m_buffer(), m_ready_tick(), m_file_open(), m_discard(), m_exit(), m_initialized(), m_path() { /* ... */ }
+
+            void Initialize();
+            void Finalize();
+        public:
+            /* Begins reading an object ahead of the request for it, replacing any earlier guess. */
+            void Start(FileSystemProxyImpl *fs, u32 object_id, const char *path);
+
+            /* If the object was guessed, waits for it to be read and hands out its open file, which the caller closes. */
+            /* The data read stays valid until the next call to Start. Otherwise, the guess is thrown away. */
+            bool Take(u32 object_id, FsFile *out_file, s64 *out_file_size, const u8 **out_data, s64 *out_data_size);
+
+            /* Throws away the guess, closing its file. */
+            void Discard();
+        private:
+            static void ThreadFunction(void *arg);
+            void ThreadFunctionImpl();
+
+            Result ReadAhead();
+            bool IsDiscarded();
+            void DiscardLocked();
+    };
+
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+#include <haze/ptp_directory_cache.hpp>
+#include <haze/ptp_object_database.hpp>
+
+namespace haze {
+
+    struct PtpObjectSnapshotStorage {
+        u32 storage_id;
+        FileSystemProxyImpl *fs;
+    };
+
+    /* On-disk copy of the object database, so that a reconnecting host is served the same object IDs. */
+    /* Each storage's size and free space are recorded with it. If they have changed, the storage was */
+    /* modified while we weren't looking, and its objects are not loaded. Directories whose listing was */
+    /* cached are recorded with their modified time, and the listing is only restored if it is unchanged. */
+    /* Only IDs and the tree are restored. A file's type and size could have changed without either check */
+    /* noticing, so they are looked up again when the host asks for them. */
+    class PtpObjectSnapshot {
+        private:
+            static constexpr u32 Magic   = util::FourCC<'H','Z','D','B'>::Code;
+            static constexpr u32 Version = 4;
+        private:
+            struct Header {
+                u32 magic;
+                u32 version;
+                u32 next_object_id;
+                u32 num_storages;
+                u32 num_objects;
+                u32 reserved;
+            };
+
+            struct Storage {
+                u32 storage_id;
+                u32 reserved;
+                s64 total_space;
+                s64 free_space;
+            };
+
+            enum ObjectFlag : u8 {
+                ObjectFlag_HasListing = (1 << 0),
+            };
+
+            /* Followed by the object's base name, without a null terminator. */
+            struct Object {
+                u32 object_id;
+                u32 parent_id;
+                u32 storage_id;
+                u16 name_length;
+                u8 flags;
+                u8 reserved;
+                u64 modified_time;
+            };
+        public:
+            static Result Save(const char *path, PtpObjectDatabase &db, const PtpDirectoryCache &directory_cache, const PtpObjectSnapshotStorage *storages, size_t num_storages);
+            static Result Load(const char *path, PtpObjectDatabase *db, PtpDirectoryCache *directory_cache, const PtpObjectSnapshotStorage *storages, size_t num_storages);
+    };
+
+}
@@ -17,10 +17,16 @@
 
 #include <haze.h>
 #include <haze/common.hpp>
-#include <haze/async_usb_server.hpp>
+#include <haze/event_reactor.hpp>
+#include <haze/ptp_directory_cache.hpp>
+#include <haze/ptp_event_queue.hpp>
 #include <haze/ptp_object_heap.hpp>
 #include <haze/ptp_object_database.hpp>
+#include <haze/ptp_object_prefetcher.hpp>
+#include <haze/ptp_object_snapshot.hpp>
 #include <haze/ptp_responder_types.hpp>
+#include <haze/transfer_tuner.hpp>
+#include <haze/transport.hpp>
 #include <optional>
 
 namespace haze {
@@ -36,10 +42,13 @@ namespace haze {
         u64 size;
     };
 
-    class PtpResponder final {
+    class PtpResponder final : public EventConsumer {
         private:
             Callback m_callback;
-            AsyncUsbServer m_usb_server;
+            EventReactor *m_reactor;
+            Transport *m_transport;
+            PtpEventQueue *m_event_queue;
+            const char *m_snapshot_path;
             std::vector<FsEntry> m_fs_entries;
             PtpUsbBulkContainer m_request_header;
             PtpObjectHeap *m_object_heap;
@@ -47,12 +56,16 @@ namespace haze {
             u32 m_send_object_id;
             std::optional<ObjectPropList> m_send_prop_list;
             bool m_session_open;
+            bool m_idle;
 
             PtpObjectDatabase m_object_database;
+            PtpDirectoryCache m_directory_cache;
+            PtpObjectPrefetcher m_prefetcher;
+            TransferTuner m_transfer_tuner;
         public:
-            constexpr explicit PtpResponder(Callback callback = nullptr) : m_callback{callback}, m_usb_server(), m_fs_entries(), m_request_header(), m_object_heap(), m_buffers(), m_send_object_id(), m_session_open(), m_object_database() { /* ... */ }
+            constexpr explicit PtpResponder(Callback callback = nullptr) : m_callback{callback}, m_reactor(), m_transport(), m_event_queue(), m_snapshot_path(), m_fs_entries(), m_request_header(), m_object_heap(), m_buffers(), m_send_object_id(), m_session_open(), m_idle(), m_object_database(), m_directory_cache(), m_prefetcher(), m_transfer_tuner() { /* ... */ }
 
-            Result Initialize(EventReactor *reactor, PtpObjectHeap *object_heap, const FsEntries& entries, u16 vid, u16 pid);
+            Result Initialize(EventReactor *reactor, PtpObjectHeap *object_heap, Transport *transport, PtpEventQueue *event_queue, const FsEntries& entries, const char *snapshot_path = nullptr);
             void Finalize();
         public:
             Result LoopProcess();
@@ -70,12 +83,35 @@ namespace haze {
                 return Fs(obj->GetStorageId());
             }
 
+            Result GetObjectEntryInfo(PtpObject *obj, FsDirEntryType *out_entry_type, s64 *out_size);
+            void PrefetchNextObject(const PtpObject *obj);
+
+            Result GetObjectPath(const PtpObject *obj, const char **out_path, size_t buffer_index = 0) {
+                char *buffer = m_buffers->object_path_buffer[buffer_index];
+                R_TRY(m_object_database.GetObjectPath(obj, buffer, sizeof(m_buffers->object_path_buffer[buffer_index])));
+
+                *out_path = buffer;
+                R_SUCCEED();
+            }
+
             /* Request handling. */
             Result HandleRequest();
             Result HandleRequestImpl();
             Result HandleCommandRequest(PtpDataParser &dp);
             void ForceCloseSession();
 
+            /* Snapshot handling. */
+            std::vector<PtpObjectSnapshotStorage> GetSnapshotStorages() const;
+            void LoadSnapshot();
+            void SaveSnapshot();
+
+            /* Event handling. */
+            void ProcessEvent() override;
+            void SendPendingEvents();
+            Result SendEvent(const PtpEvent &event);
+            Result SendEventPacket(PtpEventCode code, u32 param);
+            const FsEntry *FindFsEntry(const FileSystemProxyImpl *fs) const;
+
             Result WriteResponse(PtpResponseCode code, const void* data, size_t size);
             Result WriteResponse(PtpResponseCode code);
 
@@ -57,7 +57,12 @@ namespace haze {
         PtpOperationCode_MtpSendObjectPropList,
     };
 
-    constexpr const PtpEventCode SupportedEventCodes[]                = { /* ... */ };
+    constexpr const PtpEventCode SupportedEventCodes[] = {
+        PtpEventCode_ObjectAdded,
+        PtpEventCode_ObjectRemoved,
+        PtpEventCode_ObjectInfoChanged,
+    };
+
     constexpr const PtpDevicePropertyCode SupportedDeviceProperties[] = { /* ... */ };
     constexpr const PtpObjectFormatCode SupportedCaptureFormats[]     = { /* ... */ };
 
@@ -155,15 +160,15 @@ namespace haze {
     constexpr s64 DirectoryReadSize = 128;
 
     struct PtpBuffers {
-        char filename_string_buffer[PtpStringMaxLength + 1];
-        char capture_date_string_buffer[PtpStringMaxLength + 1];
-        char modification_date_string_buffer[PtpStringMaxLength + 1];
-        char keywords_string_buffer[PtpStringMaxLength + 1];
+        char filename_string_buffer[PtpStringMaxUtf8Length + 1];
+        char capture_date_string_buffer[PtpStringMaxUtf8Length + 1];
+        char modification_date_string_buffer[PtpStringMaxUtf8Length + 1];
+        char keywords_string_buffer[PtpStringMaxUtf8Length + 1];
 
-        FsDirectoryEntry file_system_entry_buffer[DirectoryReadSize];
+        /* Object paths are built on demand, and renames need both the old and new path. */
+        char object_path_buffer[2][FS_MAX_PATH];
 
-        alignas(4_KB) u8 usb_bulk_write_buffer[UsbBulkPacketBufferSize];
-        alignas(4_KB) u8 usb_bulk_read_buffer[UsbBulkPacketBufferSize];
+        FsDirectoryEntry file_system_entry_buffer[DirectoryReadSize];
     };
 
 }
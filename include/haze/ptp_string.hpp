@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+#include <haze/ptp.hpp>
+
+namespace haze {
+
+    /* Converts a null-terminated UTF-8 string to at most max_length UTF-16 code units, and returns how many were written. */
+    /* Conversion stops before a character that does not fit. Invalid sequences are replaced with '?'. */
+    size_t ConvertUtf8ToPtpString(u16 *dst, size_t max_length, const char *src);
+
+    /* Converts length UTF-16 code units to a null-terminated UTF-8 string of at most dst_size bytes, including the terminator. */
+    /* Conversion stops before a character that does not fit. Unpaired surrogates are replaced with '?'. */
+    void ConvertPtpStringToUtf8(char *dst, size_t dst_size, const u16 *src, size_t length);
+
+}
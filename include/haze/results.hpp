@@ -40,5 +40,10 @@ namespace haze {
     R_DEFINE_ERROR_RESULT(InvalidArgument,       16);
     R_DEFINE_ERROR_RESULT(GroupSpecified,        17);
     R_DEFINE_ERROR_RESULT(DepthSpecified,        18);
+    R_DEFINE_ERROR_RESULT(TransferBusy,          19);
+    R_DEFINE_ERROR_RESULT(Cancelled,             20);
+    R_DEFINE_ERROR_RESULT(SnapshotIoFailed,      21);
+    R_DEFINE_ERROR_RESULT(InvalidSnapshot,       22);
+    R_DEFINE_ERROR_RESULT(DeviceReset,           23);
 
 }
@@ -4,6 +4,10 @@
 #include <vapours/results.hpp>
 #include <functional>
 
+namespace haze {
+    class EventReactor;
+}
+
 namespace sphaira::thread {
 
 using Result = ams::Result;
@@ -20,7 +24,59 @@ enum class Mode {
 using ReadCallback = std::function<Result(void* data, s64 off, s64 size, u64* bytes_read)>;
 using WriteCallback = std::function<Result(const void* data, s64 off, s64 size)>;
 
+// number of buffers queued between the threads of a zero-copy transfer.
+constexpr unsigned DEFAULT_DEPTH = 2;
+constexpr unsigned MAX_DEPTH = 8;
+
+// number of threads that may read a zero-copy transfer's file, or write a buffered transfer's file, at once.
+constexpr unsigned MAX_READERS = 4;
+constexpr unsigned MAX_WRITERS = 4;
+
+// largest alignment a buffered transfer gathers its writes into, and the most memory its aligned buffers may use.
+constexpr s64 MAX_WRITE_ALIGN = 1024*1024*4;
+constexpr s64 MAX_WRITE_ALIGN_MEMORY = 1024*1024*8;
+
+// measured over a zero-copy or buffered transfer, to tune its depth and buffer size.
+struct Stats {
+    // bytes passed to the writer. for a buffered transfer, only bytes with nothing unwritten before them.
+    s64 size;
+    u64 elapsed_ns;
+    // time the reader spent waiting on the writer, and the writer on the reader.
+    u64 read_stall_ns;
+    u64 write_stall_ns;
+};
+
+// zero-copy transfers use buffers owned by the writer side.
+using AcquireCallback = std::function<Result(void** out_data, s64* out_size)>;
+using ConsumeCallback = std::function<Result(void* data, s64 off, s64 size)>;
+using ReleaseCallback = std::function<void(void* data)>;
+using ProduceCallback = std::function<Result(void** out_data, s64* out_size)>;
+
+// keeps a reader and a writer thread open between transfers, so that transfers don't create their own.
+// transfers run on threads of their own while the pool is closed.
+// a core_mask of 0 allows every core the process may use.
+Result OpenWorkerPool(int prio = 0x3B, u64 core_mask = 0);
+void CloseWorkerPool();
+
 // reads data from rfunc into wfunc.
-Result Transfer(s64 size, const ReadCallback& rfunc, const WriteCallback& wfunc, Mode mode = Mode::MultiThreaded);
+Result Transfer(s64 size, const ReadCallback& rfunc, const WriteCallback& wfunc, Mode mode = Mode::MultiThreaded, unsigned depth = DEFAULT_DEPTH);
+
+// reads data from rfunc in place into buffers from afunc, which are then passed to wfunc.
+// buffers that never reach wfunc are returned with ffunc.
+// afunc and wfunc are always called from the same thread.
+// once the reactor's cancel token is signalled, the transfer stops after the buffers in flight and returns its result.
+// while the threads run, the calling thread handles the reactor's events, see EventReactor::Serve.
+// with several readers, rfunc is called from each of them at once, for different offsets.
+Result TransferZeroCopy(s64 size, const AcquireCallback& afunc, const ReadCallback& rfunc, const ConsumeCallback& wfunc, const ReleaseCallback& ffunc, Mode mode = Mode::MultiThreaded, unsigned depth = DEFAULT_DEPTH, Stats* stats = nullptr, haze::EventReactor* reactor = nullptr, unsigned readers = 1);
+
+// passes filled buffers from pfunc to wfunc without copying, returning each with ffunc once written.
+// a buffer of size zero ends the transfer early.
+// pfunc and ffunc are always called from the same thread.
+// with several writers, wfunc is called from each of them at once, for different offsets.
+// with an alignment, produced buffers are copied into buffers of that size, so that every write but the last
+// is that size at an offset aligned to it. the alignment is capped at MAX_WRITE_ALIGN, and the buffers are kept
+// by the worker pool between transfers. fails with ResultOutOfMemory if they can't be allocated.
+// the reactor is used as for TransferZeroCopy.
+Result TransferBuffers(s64 size, const ProduceCallback& pfunc, const WriteCallback& wfunc, const ReleaseCallback& ffunc, Mode mode = Mode::MultiThreaded, unsigned depth = DEFAULT_DEPTH, Stats* stats = nullptr, haze::EventReactor* reactor = nullptr, unsigned writers = 1, s64 align = 0);
 
 } // namespace sphaira::thread
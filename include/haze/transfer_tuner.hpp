@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+#include <haze/threaded_file_transfer.hpp>
+#include <vector>
+
+namespace haze {
+
+    enum TransferDirection {
+        TransferDirection_ToHost   = 0,
+        TransferDirection_FromHost = 1,
+        TransferDirection_Count    = 2,
+    };
+
+    struct TransferConfig {
+        /* Transport packets sharing the buffer budget, or zero to leave the layout alone. */
+        u32 packet_count;
+        /* Buffers queued between the file and USB threads. */
+        u32 depth;
+    };
+
+    /* Picks the transfer configuration for each storage and direction. The first large transfers */
+    /* each try a different candidate, after which the fastest is used and kept up to date. */
+    class TransferTuner final {
+        public:
+            static constexpr s64 MinSampleSize  = 16_MB;
+            static constexpr u32 CandidateCount = 4;
+        private:
+            struct Entry {
+                u32 storage_id;
+                TransferDirection direction;
+                u64 bytes_per_second[CandidateCount];
+                u32 next_candidate;
+                u32 best_candidate;
+                bool storage_bound;
+            };
+        private:
+            std::vector<Entry> m_entries;
+        public:
+            constexpr explicit TransferTuner() : m_entries() { /* ... */ }
+
+            TransferConfig Select(u32 storage_id, TransferDirection direction, s64 size, u32 *out_candidate);
+            void Report(u32 storage_id, TransferDirection direction, u32 candidate, const sphaira::thread::Stats &stats);
+        private:
+            Entry &GetEntry(u32 storage_id, TransferDirection direction);
+    };
+
+}
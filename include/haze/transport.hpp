@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <haze/common.hpp>
+
+namespace haze {
+
+    /* The link the PTP layer speaks over. Bulk OUT and IN carry containers, interrupt IN carries events. */
+    class Transport {
+        protected:
+            enum PacketState : u8 {
+                PacketState_Free   = 0,
+                PacketState_Posted = 1,
+                PacketState_Held   = 2,
+            };
+        public:
+            virtual ~Transport() = default;
+
+            virtual bool GetConfigured() const = 0;
+
+            /* Received packets are page aligned, handed out in order, and must be released once consumed. */
+            /* A packet shorter than the read packet size ends the transfer. */
+            virtual Result AcquireReadPacket(u8 **out_data, u32 *out_size) = 0;
+            virtual void ReleaseReadPacket(const u8 *data) = 0;
+            virtual u32 GetReadPacketSize() const = 0;
+
+            /* Write buffers are page aligned, and are acquired, filled and posted in order. */
+            /* Posting does not wait for the transfer. */
+            virtual Result AcquireWriteBuffer(u8 **out_data) = 0;
+            virtual Result PostWriteBuffer(u8 *data, u32 size) = 0;
+            virtual void ReleaseWriteBuffer(const u8 *data) = 0;
+            virtual Result WaitWriteComplete() = 0;
+            virtual u32 GetWritePacketSize() const = 0;
+
+            /* The write buffer budget is fixed, so fewer packets are larger. Only valid while no write buffer is in use. */
+            virtual Result SetWritePacketCount(u32 count) = 0;
+            virtual u32 GetWritePacketCount() const = 0;
+
+            /* Interrupt packets are copied and sent without waiting, one at a time. */
+            virtual Result SendInterruptPacket(const void *data, u32 size) = 0;
+    };
+
+}
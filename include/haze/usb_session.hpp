@@ -26,6 +26,16 @@ namespace haze {
         UsbSessionEndpoint_Count     = 3,
     };
 
+    struct UsbSetupPacket {
+        u8 bmRequestType;
+        u8 bRequest;
+        u16 wValue;
+        u16 wIndex;
+        u16 wLength;
+    };
+
+    static_assert(sizeof(UsbSetupPacket) == 8);
+
     class UsbSession {
         private:
             UsbDsInterface *m_interface;
@@ -43,6 +53,15 @@ namespace haze {
             Event *GetCompletionEvent(UsbSessionEndpoint ep) const;
             Result TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 size, u32 *out_urb_id);
             Result GetTransferResult(UsbSessionEndpoint ep, u32 urb_id, u32 *out_transferred_size);
+            Result QueryTransferResult(UsbSessionEndpoint ep, u32 urb_id, bool *out_complete, u32 *out_transferred_size);
+            Result CancelTransfers(UsbSessionEndpoint ep);
+
+            /* Class requests sent to the interface on the control endpoint. */
+            Event *GetSetupEvent() const;
+            Result GetSetupPacket(UsbSetupPacket *out_setup);
+            Result ControlTransferIn(const void *data, u32 size);
+            Result ControlTransferOut(void *data, u32 size, u32 *out_transferred_size);
+            Result StallControl();
     };
 
 }
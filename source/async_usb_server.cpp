@@ -14,6 +14,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <haze.hpp>
+#include <haze/ptp_responder_types.hpp>
 
 namespace haze {
 
@@ -21,23 +22,52 @@ namespace haze {
 
         constinit UsbSession g_usb_session;
 
+        alignas(4_KB) constinit u8 g_usb_bulk_read_buffer[UsbBulkPacketBufferSize] = {};
+        alignas(4_KB) constinit u8 g_usb_bulk_write_buffer[UsbBulkPacketBufferSize] = {};
+        alignas(4_KB) constinit u8 g_usb_interrupt_buffer[4_KB] = {};
+
     }
 
-    Result AsyncUsbServer::Initialize(const UsbCommsInterfaceInfo *interface_info, u16 id_vendor, u16 id_product, EventReactor *reactor) {
+    Result AsyncUsbServer::Initialize(const UsbCommsInterfaceInfo *interface_info, u16 id_vendor, u16 id_product, EventReactor *reactor, u32 read_urb_count, u32 write_urb_count) {
         m_reactor = reactor;
 
+        /* Split the read buffer into one page-aligned packet per URB. */
+        m_read_slot_count = std::clamp<u32>(read_urb_count, 1, MaxReadUrbCount);
+        m_read_slot_size  = util::AlignDown(UsbBulkPacketBufferSize / m_read_slot_count, 4_KB);
+        for (u32 i = 0; i < m_read_slot_count; i++) {
+            m_read_slots[i] = { .data = g_usb_bulk_read_buffer + i * m_read_slot_size, .urb_id = 0, .size_transferred = 0, .state = PacketState_Free };
+        }
+
+        m_read_post_index     = 0;
+        m_read_complete_index = 0;
+
+        /* Likewise for the write buffer. */
+        this->LayoutWriteSlots(write_urb_count);
+        m_interrupt_pending   = false;
+
         /* Set up a new USB session. */
         R_TRY(g_usb_session.Initialize(interface_info, id_vendor, id_product));
 
+        /* Handle class requests while waiting for anything else. */
+        R_UNLESS(m_reactor->AddConsumer(this, waiterForEvent(g_usb_session.GetSetupEvent())), haze::ResultRegistrationFailed());
+
         R_SUCCEED();
     }
 
     void AsyncUsbServer::Finalize() {
+        m_reactor->RemoveConsumer(this);
+
+        this->ResetReadSlots();
+        this->ResetWriteSlots();
+
         g_usb_session.Finalize();
     }
 
-    Result AsyncUsbServer::TransferPacketImpl(bool read, void *page, u32 size, u32 *out_size_transferred) const {
-        u32 urb_id;
+    bool AsyncUsbServer::GetConfigured() const {
+        return g_usb_session.GetConfigured();
+    }
+
+    Result AsyncUsbServer::WaitForConfigured() const {
         s32 waiter_idx;
 
         /* If we're not configured yet, wait to become configured first. */
@@ -48,15 +78,282 @@ namespace haze {
             R_THROW(haze::ResultNotConfigured());
         }
 
-        /* Select the appropriate endpoint and begin a transfer. */
-        UsbSessionEndpoint ep = read ? UsbSessionEndpoint_Read : UsbSessionEndpoint_Write;
-        R_TRY(g_usb_session.TransferAsync(ep, page, size, std::addressof(urb_id)));
+        R_SUCCEED();
+    }
+
+    Result AsyncUsbServer::WaitForTransfer(UsbSessionEndpoint ep, u32 urb_id, u32 *out_size_transferred) {
+        /* Other URBs on the endpoint may complete first, so keep waiting until this one has. */
+        while (true) {
+            bool complete;
+            R_TRY(g_usb_session.QueryTransferResult(ep, urb_id, std::addressof(complete), out_size_transferred));
+
+            R_SUCCEED_IF(complete);
+
+            s32 waiter_idx;
+            R_TRY(m_reactor->WaitFor(std::addressof(waiter_idx), waiterForEvent(g_usb_session.GetCompletionEvent(ep)), waiterForEvent(usbDsGetStateChangeEvent())));
+
+            /* If the cable was pulled, the transfer will never complete. */
+            if (waiter_idx == 1) {
+                R_TRY(eventClear(usbDsGetStateChangeEvent()));
+                R_UNLESS(g_usb_session.GetConfigured(), haze::ResultNotConfigured());
+            }
+        }
+    }
+
+    void AsyncUsbServer::ProcessEvent() {
+        UsbSetupPacket setup;
+        if (R_FAILED(g_usb_session.GetSetupPacket(std::addressof(setup)))) {
+            return;
+        }
+
+        /* Refuse requests we don't understand. */
+        if (R_FAILED(this->HandleClassRequest(setup))) {
+            g_usb_session.StallControl();
+        }
+    }
+
+    Result AsyncUsbServer::HandleClassRequest(const UsbSetupPacket &setup) {
+        CancelToken *cancel_token = m_reactor->GetCancelToken();
+
+        R_UNLESS(cancel_token != nullptr,                                          haze::ResultOperationNotSupported());
+        R_UNLESS((setup.bmRequestType & ~USB_ENDPOINT_IN) == PtpUsbClassRequestType, haze::ResultOperationNotSupported());
+
+        switch (setup.bRequest) {
+            case PtpUsbClassRequest_Cancel:
+                {
+                    /* Only one transaction is ever in progress, so the one named must be it. */
+                    R_UNLESS(setup.wLength == PtpUsbCancelRequestLength, haze::ResultInvalidArgument());
+
+                    u8 request[PtpUsbCancelRequestLength];
+                    u32 size_transferred;
+                    R_TRY(g_usb_session.ControlTransferOut(request, sizeof(request), std::addressof(size_transferred)));
+
+                    /* Abort whatever is in progress, and complete the status stage. */
+                    cancel_token->Cancel(haze::ResultCancelled());
+                    R_RETURN(g_usb_session.ControlTransferIn(nullptr, 0));
+                }
+            case PtpUsbClassRequest_DeviceReset:
+                {
+                    /* Abort whatever is in progress, and acknowledge the request. The responder closes the session. */
+                    cancel_token->Cancel(haze::ResultDeviceReset());
+                    R_RETURN(g_usb_session.ControlTransferIn(nullptr, 0));
+                }
+            case PtpUsbClassRequest_GetDeviceStatus:
+                {
+                    /* Report busy until the responder has cleaned up after a cancelled transaction. */
+                    const u16 status[2] = { sizeof(status), cancel_token->IsCancelled() ? PtpResponseCode_DeviceBusy : PtpResponseCode_Ok };
+                    R_RETURN(g_usb_session.ControlTransferIn(status, std::min<u32>(sizeof(status), setup.wLength)));
+                }
+            default:
+                R_THROW(haze::ResultOperationNotSupported());
+        }
+    }
+
+    Result AsyncUsbServer::PostReadSlots() {
+        /* Queue free slots in ring order, so that packets complete in the order they are handed out. */
+        while (m_read_slots[m_read_post_index].state == PacketState_Free) {
+            ReadSlot &slot = m_read_slots[m_read_post_index];
+
+            R_TRY(g_usb_session.TransferAsync(UsbSessionEndpoint_Read, slot.data, m_read_slot_size, std::addressof(slot.urb_id)));
+
+            slot.state = PacketState_Posted;
+            m_read_post_index = (m_read_post_index + 1) % m_read_slot_count;
+        }
+
+        R_SUCCEED();
+    }
+
+    void AsyncUsbServer::ResetReadSlots() {
+        bool has_posted = false;
+
+        /* Forget about every slot, including any which are still held. */
+        for (u32 i = 0; i < m_read_slot_count; i++) {
+            has_posted |= m_read_slots[i].state == PacketState_Posted;
+            m_read_slots[i].state = PacketState_Free;
+        }
+
+        /* Cancel anything still in flight, as its data would arrive out of order. */
+        if (has_posted) {
+            g_usb_session.CancelTransfers(UsbSessionEndpoint_Read);
+        }
+
+        m_read_post_index     = 0;
+        m_read_complete_index = 0;
+    }
+
+    Result AsyncUsbServer::AcquireReadPacket(u8 **out_data, u32 *out_size) {
+        ReadSlot &slot = m_read_slots[m_read_complete_index];
+
+        /* Ensure we maintain a clean state on failure. */
+        ON_RESULT_FAILURE { this->ResetReadSlots(); };
+
+        /* If nothing is queued, we must be configured before queueing anything. */
+        if (slot.state == PacketState_Free) {
+            R_TRY(this->WaitForConfigured());
+        }
+
+        /* Every held packet must have been released before the ring wraps around to it. */
+        R_UNLESS(slot.state != PacketState_Held, haze::ResultTransferFailed());
 
-        /* Try to wait for the event. */
-        R_TRY(m_reactor->WaitFor(std::addressof(waiter_idx), waiterForEvent(g_usb_session.GetCompletionEvent(ep))));
+        /* Keep the endpoint busy while we wait. */
+        R_TRY(this->PostReadSlots());
 
-        /* Return what we transferred. */
-        R_RETURN(g_usb_session.GetTransferResult(ep, urb_id, out_size_transferred));
+        /* Wait for the oldest URB to complete. */
+        R_TRY(this->WaitForTransfer(UsbSessionEndpoint_Read, slot.urb_id, std::addressof(slot.size_transferred)));
+
+        /* Hand out the packet. */
+        slot.state = PacketState_Held;
+        m_read_complete_index = (m_read_complete_index + 1) % m_read_slot_count;
+
+        *out_data = slot.data;
+        *out_size = slot.size_transferred;
+        R_SUCCEED();
+    }
+
+    void AsyncUsbServer::ReleaseReadPacket(const u8 *data) {
+        for (u32 i = 0; i < m_read_slot_count; i++) {
+            if (m_read_slots[i].data == data && m_read_slots[i].state == PacketState_Held) {
+                /* The slot will be queued again on the next acquire. */
+                m_read_slots[i].state = PacketState_Free;
+                return;
+            }
+        }
+    }
+
+    void AsyncUsbServer::LayoutWriteSlots(u32 count) {
+        /* At least two buffers are needed to overlap filling with sending. */
+        m_write_slot_count = std::clamp<u32>(count, 2, MaxWriteUrbCount);
+        m_write_slot_size  = util::AlignDown(UsbBulkPacketBufferSize / m_write_slot_count, 4_KB);
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            m_write_slots[i] = { .data = g_usb_bulk_write_buffer + i * m_write_slot_size, .urb_id = 0, .state = PacketState_Free };
+        }
+
+        m_write_acquire_index = 0;
+    }
+
+    Result AsyncUsbServer::SetWritePacketCount(u32 count) {
+        /* Buffers can only be moved while none of them are in use. */
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            R_UNLESS(m_write_slots[i].state == PacketState_Free, haze::ResultTransferBusy());
+        }
+
+        this->LayoutWriteSlots(count);
+        R_SUCCEED();
+    }
+
+    Result AsyncUsbServer::WaitWriteSlot(WriteSlot &slot) {
+        /* Ensure we maintain a clean state on failure. */
+        ON_RESULT_FAILURE { this->ResetWriteSlots(); };
+
+        u32 size_transferred;
+        R_TRY(this->WaitForTransfer(UsbSessionEndpoint_Write, slot.urb_id, std::addressof(size_transferred)));
+
+        slot.state = PacketState_Free;
+        R_SUCCEED();
+    }
+
+    void AsyncUsbServer::ResetWriteSlots() {
+        bool has_posted = false;
+
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            has_posted |= m_write_slots[i].state == PacketState_Posted;
+            m_write_slots[i].state = PacketState_Free;
+        }
+
+        if (has_posted) {
+            g_usb_session.CancelTransfers(UsbSessionEndpoint_Write);
+        }
+
+        m_write_acquire_index = 0;
+    }
+
+    Result AsyncUsbServer::AcquireWriteBuffer(u8 **out_data) {
+        WriteSlot &slot = m_write_slots[m_write_acquire_index];
+
+        /* Ensure we maintain a clean state on failure. */
+        ON_RESULT_FAILURE { this->ResetWriteSlots(); };
+
+        /* Every acquired buffer must have been posted or released before the ring wraps around to it. */
+        R_UNLESS(slot.state != PacketState_Held, haze::ResultTransferFailed());
+
+        /* If the buffer is still being sent, wait for it to finish. */
+        if (slot.state == PacketState_Posted) {
+            R_TRY(this->WaitWriteSlot(slot));
+        }
+
+        slot.state = PacketState_Held;
+        m_write_acquire_index = (m_write_acquire_index + 1) % m_write_slot_count;
+
+        *out_data = slot.data;
+        R_SUCCEED();
+    }
+
+    Result AsyncUsbServer::PostWriteBuffer(u8 *data, u32 size) {
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            WriteSlot &slot = m_write_slots[i];
+            if (slot.data != data || slot.state != PacketState_Held) {
+                continue;
+            }
+
+            /* Ensure we maintain a clean state on failure. */
+            ON_RESULT_FAILURE { this->ResetWriteSlots(); };
+
+            /* If we're not configured yet, wait to become configured first. */
+            R_TRY(this->WaitForConfigured());
+
+            /* Begin the transfer. Completion is collected when the buffer is next needed. */
+            R_TRY(g_usb_session.TransferAsync(UsbSessionEndpoint_Write, slot.data, size, std::addressof(slot.urb_id)));
+
+            slot.state = PacketState_Posted;
+            R_SUCCEED();
+        }
+
+        R_THROW(haze::ResultTransferFailed());
+    }
+
+    void AsyncUsbServer::ReleaseWriteBuffer(const u8 *data) {
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            if (m_write_slots[i].data == data && m_write_slots[i].state == PacketState_Held) {
+                m_write_slots[i].state = PacketState_Free;
+                return;
+            }
+        }
+    }
+
+    Result AsyncUsbServer::WaitWriteComplete() {
+        /* Wait for buffers in the order they were acquired, oldest first. */
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            WriteSlot &slot = m_write_slots[(m_write_acquire_index + i) % m_write_slot_count];
+
+            if (slot.state == PacketState_Posted) {
+                R_TRY(this->WaitWriteSlot(slot));
+            }
+        }
+
+        R_SUCCEED();
+    }
+
+    Result AsyncUsbServer::SendInterruptPacket(const void *data, u32 size) {
+        R_UNLESS(size <= sizeof(g_usb_interrupt_buffer), haze::ResultInvalidArgument());
+        R_UNLESS(g_usb_session.GetConfigured(),          haze::ResultNotConfigured());
+
+        /* Only one interrupt packet may be in flight. */
+        if (m_interrupt_pending) {
+            bool complete;
+            u32 size_transferred;
+            const Result rc = g_usb_session.QueryTransferResult(UsbSessionEndpoint_Interrupt, m_interrupt_urb_id, std::addressof(complete), std::addressof(size_transferred));
+
+            /* A failed packet is as good as a completed one here. */
+            R_UNLESS(R_FAILED(rc) || complete, haze::ResultTransferBusy());
+
+            m_interrupt_pending = false;
+        }
+
+        std::memcpy(g_usb_interrupt_buffer, data, size);
+        R_TRY(g_usb_session.TransferAsync(UsbSessionEndpoint_Interrupt, g_usb_interrupt_buffer, size, std::addressof(m_interrupt_urb_id)));
+
+        m_interrupt_pending = true;
+        R_SUCCEED();
     }
 
 }
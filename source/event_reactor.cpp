@@ -17,6 +17,11 @@
 
 namespace haze {
 
+    void EventReactor::Initialize() {
+        m_serving = false;
+        ueventCreate(std::addressof(m_serving_done_event), false);
+    }
+
     bool EventReactor::AddConsumer(EventConsumer *consumer, Waiter waiter) {
         HAZE_ASSERT(m_num_wait_objects + 1 <= svc::ArgumentHandleCountMax);
 
@@ -48,25 +53,68 @@ namespace haze {
         m_num_wait_objects = output_index;
     }
 
-    Result EventReactor::WaitForImpl(s32 *out_arg_waiter, const Waiter *arg_waiters, s32 num_arg_waiters) {
+    void EventReactor::BeginServing() {
+        /* Other waiters only wait on the event while we serve, so it can't be cleared under them. */
+        ueventClear(std::addressof(m_serving_done_event));
+        m_serving = true;
+    }
+
+    void EventReactor::EndServing() {
+        /* Wake other waiters, so that they wait on the consumers again. */
+        m_serving = false;
+        ueventSignal(std::addressof(m_serving_done_event));
+    }
+
+    Result EventReactor::WaitForImpl(s32 *out_arg_waiter, const Waiter *arg_waiters, s32 num_arg_waiters, bool serving) {
         HAZE_ASSERT(0 < num_arg_waiters && num_arg_waiters <= svc::ArgumentHandleCountMax);
-        HAZE_ASSERT(m_num_wait_objects + num_arg_waiters <= svc::ArgumentHandleCountMax);
+        HAZE_ASSERT(m_num_wait_objects + num_arg_waiters + 2 <= svc::ArgumentHandleCountMax);
 
         while (true) {
             /* Check if we should wait for an event. */
-            R_TRY(m_result);
+            R_TRY(this->GetResult());
+
+            /* Check if the wait has been cancelled. */
+            if (m_cancel_token != nullptr) {
+                R_TRY(m_cancel_token->GetResult());
+            }
+
+            /* Waits may happen on several threads at once, so each builds its own list. */
+            Waiter waiters[svc::ArgumentHandleCountMax];
+            s32 num_waiters = 0;
+
+            /* While another thread serves the consumers, leave them to it until it stops. */
+            const bool with_consumers = serving || !m_serving;
+            const s32 num_consumer_waiters = with_consumers ? m_num_wait_objects : 0;
+            for (s32 i = 0; i < num_consumer_waiters; i++) {
+                waiters[num_waiters++] = m_waiters[i];
+            }
 
             /* Insert waiters from argument list. */
             for (s32 i = 0; i < num_arg_waiters; i++) {
-                m_waiters[i + m_num_wait_objects] = arg_waiters[i];
+                waiters[num_waiters++] = arg_waiters[i];
+            }
+
+            /* Anything after the arguments only makes us check again at the top of the loop. */
+            const s32 num_checked_waiters = num_waiters;
+            if (!with_consumers) {
+                waiters[num_waiters++] = waiterForUEvent(std::addressof(m_serving_done_event));
+            }
+
+            if (m_cancel_token != nullptr) {
+                waiters[num_waiters++] = m_cancel_token->GetWaiter();
             }
 
             s32 idx;
-            HAZE_R_ABORT_UNLESS(waitObjects(std::addressof(idx), m_waiters, m_num_wait_objects + num_arg_waiters, svc::WaitInfinite));
+            HAZE_R_ABORT_UNLESS(waitObjects(std::addressof(idx), waiters, num_waiters, svc::WaitInfinite));
+
+            /* If the cancel token was signaled, the check above will fail the wait. */
+            if (idx >= num_checked_waiters) {
+                continue;
+            }
 
             /* If a waiter in the argument list was signaled, return it. */
-            if (idx >= m_num_wait_objects) {
-                *out_arg_waiter = idx - m_num_wait_objects;
+            if (idx >= num_consumer_waiters) {
+                *out_arg_waiter = idx - num_consumer_waiters;
                 R_SUCCEED();
             }
 
@@ -25,7 +25,7 @@ std::unique_ptr<haze::ConsoleMainLoop> g_haze{};
 
 } // namespace
 
-bool Initialize(Callback callback, int prio, int cpuid, const FsEntries& entries, u16 vid, u16 pid) {
+bool Initialize(Callback callback, int prio, int cpuid, const FsEntries& entries, u16 vid, u16 pid, size_t object_heap_budget, const char* snapshot_path, int transfer_prio, u64 transfer_core_mask) {
     std::scoped_lock lock{g_mutex};
     if (g_haze) {
         return false;
@@ -38,7 +38,7 @@ bool Initialize(Callback callback, int prio, int cpuid, const FsEntries& entries
     /* Load device firmware version and serial number. */
     HAZE_R_ABORT_UNLESS(haze::LoadDeviceProperties());
 
-    g_haze = std::make_unique<haze::ConsoleMainLoop>(callback, prio, cpuid, entries, vid, pid);
+    g_haze = std::make_unique<haze::ConsoleMainLoop>(callback, prio, cpuid, entries, vid, pid, object_heap_budget, snapshot_path, transfer_prio, transfer_core_mask);
 
     return true;
 }
@@ -53,4 +53,13 @@ void Exit() {
     g_haze.reset();
 }
 
+bool Notify(NotifyType type, const FileSystemProxyImpl* fs, const char* path) {
+    std::scoped_lock lock{g_mutex};
+    if (!g_haze) {
+        return false;
+    }
+
+    return g_haze->Notify(type, fs, path);
+}
+
 } // namespace haze
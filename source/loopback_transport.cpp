@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/loopback_transport.hpp>
+
+namespace haze {
+
+    namespace {
+
+        Result WaitForEvent(EventReactor *reactor, UEvent *event) {
+            /* Without a reactor, there is nothing to stop the wait early. */
+            if (reactor == nullptr) {
+                R_RETURN(waitSingle(waiterForUEvent(event), UINT64_MAX));
+            }
+
+            s32 waiter_idx;
+            R_RETURN(reactor->WaitFor(std::addressof(waiter_idx), waiterForUEvent(event)));
+        }
+
+    }
+
+    void LoopbackPipe::Initialize(const LoopbackLinkModel &model) {
+        m_model       = model;
+        m_read_offset = 0;
+        m_wire_tick   = 0;
+
+        m_write_count.store(0, std::memory_order_relaxed);
+        m_read_count.store(0, std::memory_order_relaxed);
+
+        ueventCreate(std::addressof(m_readable_event), true);
+        ueventCreate(std::addressof(m_writable_event), true);
+    }
+
+    Result LoopbackPipe::Push(EventReactor *reactor, const u8 *data, u32 size, u32 *out_sequence) {
+        const u32 write_count = m_write_count.load(std::memory_order_relaxed);
+
+        /* Wait for room in the ring. */
+        while (write_count - m_read_count.load(std::memory_order_acquire) >= SegmentCount) {
+            R_TRY(WaitForEvent(reactor, std::addressof(m_writable_event)));
+        }
+
+        /* Transfers queue behind each other on the wire, and then take the link latency to arrive. */
+        m_wire_tick = std::max(m_wire_tick, armGetSystemTick());
+        if (m_model.bytes_per_second != 0) {
+            m_wire_tick += armNsToTicks(static_cast<u64>(size) * 1'000'000'000 / m_model.bytes_per_second);
+        }
+
+        m_segments[write_count % SegmentCount] = { .data = data, .size = size, .ready_tick = m_wire_tick + armNsToTicks(m_model.latency_ns) };
+
+        /* Publish the segment. */
+        m_write_count.store(write_count + 1, std::memory_order_release);
+        ueventSignal(std::addressof(m_readable_event));
+
+        *out_sequence = write_count;
+        R_SUCCEED();
+    }
+
+    bool LoopbackPipe::IsConsumed(u32 sequence) const {
+        return static_cast<s32>(m_read_count.load(std::memory_order_acquire) - sequence) > 0;
+    }
+
+    Result LoopbackPipe::WaitConsumed(EventReactor *reactor, u32 sequence) {
+        while (!this->IsConsumed(sequence)) {
+            R_TRY(WaitForEvent(reactor, std::addressof(m_writable_event)));
+        }
+
+        R_SUCCEED();
+    }
+
+    Result LoopbackPipe::Read(EventReactor *reactor, u8 *data, u32 size, u32 *out_size) {
+        u32 received = 0;
+
+        while (received < size) {
+            const u32 read_count = m_read_count.load(std::memory_order_relaxed);
+
+            /* Wait for a segment to be posted. */
+            if (read_count == m_write_count.load(std::memory_order_acquire)) {
+                R_TRY(WaitForEvent(reactor, std::addressof(m_readable_event)));
+                continue;
+            }
+
+            const Segment &segment = m_segments[read_count % SegmentCount];
+
+            /* Wait for it to arrive. */
+            const u64 tick = armGetSystemTick();
+            if (tick < segment.ready_tick) {
+                svcSleepThread(armTicksToNs(segment.ready_tick - tick));
+            }
+
+            const u32 copy_size = std::min(segment.size - m_read_offset, size - received);
+            std::memcpy(data + received, segment.data + m_read_offset, copy_size);
+
+            received      += copy_size;
+            m_read_offset += copy_size;
+
+            if (m_read_offset == segment.size) {
+                /* A short packet, including a zero length packet, ends the transfer. */
+                const bool short_packet = segment.size == 0 || (segment.size % PtpUsbBulkHighSpeedMaxPacketLength) != 0;
+
+                /* Hand the segment back to the producer. */
+                m_read_offset = 0;
+                m_read_count.store(read_count + 1, std::memory_order_release);
+                ueventSignal(std::addressof(m_writable_event));
+
+                if (short_packet) {
+                    break;
+                }
+            }
+        }
+
+        *out_size = received;
+        R_SUCCEED();
+    }
+
+    Result LoopbackTransport::Initialize(EventReactor *reactor, LoopbackPipe *read_pipe, LoopbackPipe *write_pipe, LoopbackPipe *interrupt_pipe) {
+        m_reactor        = reactor;
+        m_read_pipe      = read_pipe;
+        m_write_pipe     = write_pipe;
+        m_interrupt_pipe = interrupt_pipe;
+
+        /* Allocate one packet buffer per slot, for each direction. */
+        m_buffer = static_cast<u8 *>(std::aligned_alloc(4_KB, 2 * PacketCount * PacketSize));
+        R_UNLESS(m_buffer != nullptr, haze::ResultOutOfMemory());
+
+        for (u32 i = 0; i < PacketCount; i++) {
+            m_read_slots[i] = { .data = m_buffer + i * PacketSize, .state = PacketState_Free };
+        }
+
+        m_read_index        = 0;
+        m_interrupt_pending = false;
+
+        /* Lay out the write packets. */
+        m_write_slot_count = 0;
+        R_RETURN(this->SetWritePacketCount(PacketCount));
+    }
+
+    Result LoopbackTransport::SetWritePacketCount(u32 count) {
+        /* Buffers can only be moved while none of them are in use. */
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            R_UNLESS(m_write_slots[i].state == PacketState_Free, haze::ResultTransferBusy());
+        }
+
+        /* The write half of the buffer is shared between however many packets we use. */
+        m_write_slot_count = std::clamp<u32>(count, 2, MaxWritePacketCount);
+        m_write_slot_size  = util::AlignDown(PacketCount * PacketSize / m_write_slot_count, 4_KB);
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            m_write_slots[i] = { .data = m_buffer + PacketCount * PacketSize + i * m_write_slot_size, .sequence = 0, .state = PacketState_Free };
+        }
+
+        m_write_index = 0;
+        R_SUCCEED();
+    }
+
+    void LoopbackTransport::Finalize() {
+        std::free(m_buffer);
+        m_buffer = nullptr;
+    }
+
+    Result LoopbackTransport::AcquireReadPacket(u8 **out_data, u32 *out_size) {
+        ReadSlot &slot = m_read_slots[m_read_index];
+
+        /* Every held packet must have been released before the ring wraps around to it. */
+        R_UNLESS(slot.state != PacketState_Held, haze::ResultTransferFailed());
+
+        R_TRY(m_read_pipe->Read(m_reactor, slot.data, PacketSize, out_size));
+
+        slot.state = PacketState_Held;
+        m_read_index = (m_read_index + 1) % PacketCount;
+
+        *out_data = slot.data;
+        R_SUCCEED();
+    }
+
+    void LoopbackTransport::ReleaseReadPacket(const u8 *data) {
+        for (auto &slot : m_read_slots) {
+            if (slot.data == data && slot.state == PacketState_Held) {
+                slot.state = PacketState_Free;
+                return;
+            }
+        }
+    }
+
+    Result LoopbackTransport::AcquireWriteBuffer(u8 **out_data) {
+        WriteSlot &slot = m_write_slots[m_write_index];
+
+        /* Every acquired buffer must have been posted or released before the ring wraps around to it. */
+        R_UNLESS(slot.state != PacketState_Held, haze::ResultTransferFailed());
+
+        /* If the buffer is still being read by the other side, wait for it to finish. */
+        if (slot.state == PacketState_Posted) {
+            R_TRY(m_write_pipe->WaitConsumed(m_reactor, slot.sequence));
+        }
+
+        slot.state = PacketState_Held;
+        m_write_index = (m_write_index + 1) % m_write_slot_count;
+
+        *out_data = slot.data;
+        R_SUCCEED();
+    }
+
+    Result LoopbackTransport::PostWriteBuffer(u8 *data, u32 size) {
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            WriteSlot &slot = m_write_slots[i];
+            if (slot.data == data && slot.state == PacketState_Held) {
+                R_TRY(m_write_pipe->Push(m_reactor, slot.data, size, std::addressof(slot.sequence)));
+
+                slot.state = PacketState_Posted;
+                R_SUCCEED();
+            }
+        }
+
+        R_THROW(haze::ResultTransferFailed());
+    }
+
+    void LoopbackTransport::ReleaseWriteBuffer(const u8 *data) {
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            WriteSlot &slot = m_write_slots[i];
+            if (slot.data == data && slot.state == PacketState_Held) {
+                slot.state = PacketState_Free;
+                return;
+            }
+        }
+    }
+
+    Result LoopbackTransport::WaitWriteComplete() {
+        /* Segments are consumed in order, so waiting on each posted buffer in turn is enough. */
+        for (u32 i = 0; i < m_write_slot_count; i++) {
+            WriteSlot &slot = m_write_slots[i];
+            if (slot.state == PacketState_Posted) {
+                R_TRY(m_write_pipe->WaitConsumed(m_reactor, slot.sequence));
+                slot.state = PacketState_Free;
+            }
+        }
+
+        R_SUCCEED();
+    }
+
+    Result LoopbackTransport::SendInterruptPacket(const void *data, u32 size) {
+        R_UNLESS(size <= sizeof(m_interrupt_buffer), haze::ResultInvalidArgument());
+
+        /* Only one interrupt packet may be in flight. */
+        R_UNLESS(!m_interrupt_pending || m_interrupt_pipe->IsConsumed(m_interrupt_sequence), haze::ResultTransferBusy());
+
+        std::memcpy(m_interrupt_buffer, data, size);
+        R_TRY(m_interrupt_pipe->Push(m_reactor, m_interrupt_buffer, size, std::addressof(m_interrupt_sequence)));
+
+        m_interrupt_pending = true;
+        R_SUCCEED();
+    }
+
+    Result LoopbackTransport::ReceiveInterruptPacket(void *data, u32 size, u32 *out_size) {
+        R_RETURN(m_interrupt_pipe->Read(m_reactor, static_cast<u8 *>(data), size, out_size));
+    }
+
+    Result LoopbackLink::Initialize(EventReactor *device_reactor, const LoopbackLinkModel &model) {
+        m_host_to_device_pipe.Initialize(model);
+        m_device_to_host_pipe.Initialize(model);
+        m_interrupt_pipe.Initialize(model);
+
+        /* Ensure we maintain a clean state on failure. */
+        ON_RESULT_FAILURE { this->Finalize(); };
+
+        R_TRY(m_device.Initialize(device_reactor, std::addressof(m_host_to_device_pipe), std::addressof(m_device_to_host_pipe), std::addressof(m_interrupt_pipe)));
+        R_TRY(m_host.Initialize(nullptr, std::addressof(m_device_to_host_pipe), std::addressof(m_host_to_device_pipe), std::addressof(m_interrupt_pipe)));
+
+        R_SUCCEED();
+    }
+
+    void LoopbackLink::Finalize() {
+        m_host.Finalize();
+        m_device.Finalize();
+    }
+
+}
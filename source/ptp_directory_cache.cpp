@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/ptp_directory_cache.hpp>
+
+namespace haze {
+
+    void PtpDirectoryCache::Initialize() {
+        for (auto &entry : m_entries) {
+            entry = {};
+        }
+    }
+
+    void PtpDirectoryCache::Finalize() {
+        this->Initialize();
+    }
+
+    bool PtpDirectoryCache::Find(const PtpObject *directory) {
+        const u64 tick = armGetSystemTick();
+
+        for (auto &entry : m_entries) {
+            if (!entry.valid || entry.object_id != directory->GetObjectId()) {
+                continue;
+            }
+
+            /* Drop the listing if we changed the directory, or it may have been changed by someone else. */
+            if (!IsEntryCurrent(entry, directory, tick)) {
+                entry = {};
+                return false;
+            }
+
+            entry.used_tick = tick;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool PtpDirectoryCache::Contains(const PtpObject *directory) const {
+        const u64 tick = armGetSystemTick();
+
+        for (const auto &entry : m_entries) {
+            if (entry.valid && entry.object_id == directory->GetObjectId()) {
+                return IsEntryCurrent(entry, directory, tick);
+            }
+        }
+
+        return false;
+    }
+
+    bool PtpDirectoryCache::IsEntryCurrent(const Entry &entry, const PtpObject *directory, u64 tick) {
+        return entry.generation == directory->GetGeneration() && armTicksToNs(tick - entry.created_tick) < MaxEntryAgeNs;
+    }
+
+    void PtpDirectoryCache::Store(const PtpObject *directory) {
+        /* Replace an older listing of the same directory, or else the least recently used one. */
+        Entry *victim = std::addressof(m_entries[0]);
+        for (auto &entry : m_entries) {
+            if (entry.valid && entry.object_id == directory->GetObjectId()) {
+                victim = std::addressof(entry);
+                break;
+            }
+
+            if (!entry.valid || entry.used_tick < victim->used_tick) {
+                victim = std::addressof(entry);
+            }
+        }
+
+        const u64 tick = armGetSystemTick();
+
+        *victim = {
+            .object_id    = directory->GetObjectId(),
+            .generation   = directory->GetGeneration(),
+            .created_tick = tick,
+            .used_tick    = tick,
+            .valid        = true,
+        };
+    }
+
+}
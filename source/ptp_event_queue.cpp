@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+
+namespace haze {
+
+    void PtpEventQueue::Initialize() {
+        mutexInit(std::addressof(m_mutex));
+        ueventCreate(std::addressof(m_event), true);
+
+        m_read_index = 0;
+        m_count = 0;
+    }
+
+    bool PtpEventQueue::Push(NotifyType type, const FileSystemProxyImpl *fs, const char *path) {
+        /* Paths are always absolute within the filesystem. */
+        if (fs == nullptr || path == nullptr || path[0] != '/' || std::strlen(path) >= FS_MAX_PATH) {
+            return false;
+        }
+
+        PtpEvent event = { .type = type, .fs = fs, .object_id = 0 };
+        std::strcpy(event.path, path);
+
+        return this->PushImpl(event);
+    }
+
+    bool PtpEventQueue::Push(NotifyType type, u32 object_id) {
+        const PtpEvent event = { .type = type, .fs = nullptr, .object_id = object_id };
+
+        return this->PushImpl(event);
+    }
+
+    bool PtpEventQueue::PushImpl(const PtpEvent &event) {
+        {
+            mutexLock(std::addressof(m_mutex));
+            ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+            /* If the host is not keeping up, drop the event rather than blocking the poster. */
+            if (m_count == MaxEvents) {
+                return false;
+            }
+
+            m_events[(m_read_index + m_count) % MaxEvents] = event;
+            m_count++;
+        }
+
+        ueventSignal(std::addressof(m_event));
+        return true;
+    }
+
+    bool PtpEventQueue::Peek(PtpEvent *out_event) {
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        if (m_count == 0) {
+            return false;
+        }
+
+        *out_event = m_events[m_read_index];
+        return true;
+    }
+
+    void PtpEventQueue::Pop() {
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        if (m_count > 0) {
+            m_read_index = (m_read_index + 1) % MaxEvents;
+            m_count--;
+        }
+    }
+
+    void PtpEventQueue::Clear() {
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        m_read_index = 0;
+        m_count = 0;
+    }
+
+}
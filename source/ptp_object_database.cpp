@@ -17,19 +17,343 @@
 
 namespace haze {
 
+    namespace {
+
+        constexpr u32 FnvOffsetBasis = 0x811C9DC5;
+        constexpr u32 FnvPrime       = 0x01000193;
+
+        constexpr u8 FoldCase(u8 c) {
+            /* Fold the same way as strcasecmp, which only folds ASCII. */
+            return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        }
+
+    }
+
+    void PtpObjectNameIndex::Initialize() {
+        m_entries  = nullptr;
+        m_capacity = 0;
+        m_count    = 0;
+    }
+
+    void PtpObjectNameIndex::Finalize() {
+        std::free(m_entries);
+
+        m_entries  = nullptr;
+        m_capacity = 0;
+        m_count    = 0;
+    }
+
+    u32 PtpObjectNameIndex::HashName(const char *name) {
+        u32 hash = FnvOffsetBasis;
+
+        while (*name != '\x00') {
+            hash = (hash ^ FoldCase(*name++)) * FnvPrime;
+        }
+
+        return hash;
+    }
+
+    PtpObject *PtpObjectNameIndex::Find(u32 parent_id, const char *name, u32 name_hash) const {
+        if (m_count == 0) {
+            return nullptr;
+        }
+
+        const u32 key = MakeKey(parent_id, name_hash);
+
+        /* Probe until we hit an empty entry, which ends the run of colliding keys. */
+        for (u32 i = this->GetHomeIndex(key); m_entries[i].object != nullptr; i = (i + 1) & (m_capacity - 1)) {
+            const Entry &entry = m_entries[i];
+            if (entry.key != key) {
+                continue;
+            }
+
+            const PtpObject *object = entry.object;
+            if (object->GetParentId() == parent_id && object->GetNameHash() == name_hash && strcasecmp(object->GetBaseName(), name) == 0) {
+                return entry.object;
+            }
+        }
+
+        return nullptr;
+    }
+
+    Result PtpObjectNameIndex::Insert(PtpObject *object) {
+        /* Keep the load factor at or below 3/4, so probe runs stay short. */
+        if ((m_count + 1) * 4 > m_capacity * 3) {
+            /* If we can't grow, keep filling the table while an empty entry is left to end probing. */
+            if (!this->Grow()) {
+                R_UNLESS(m_count + 1 < m_capacity, haze::ResultOutOfMemory());
+            }
+        }
+
+        const u32 key = MakeKey(object->GetParentId(), object->GetNameHash());
+
+        u32 i = this->GetHomeIndex(key);
+        while (m_entries[i].object != nullptr) {
+            i = (i + 1) & (m_capacity - 1);
+        }
+
+        m_entries[i] = { .key = key, .object = object };
+        m_count++;
+
+        R_SUCCEED();
+    }
+
+    void PtpObjectNameIndex::Erase(PtpObject *object) {
+        if (m_count == 0) {
+            return;
+        }
+
+        const u32 key = MakeKey(object->GetParentId(), object->GetNameHash());
+
+        /* Find the entry for the object. */
+        u32 i = this->GetHomeIndex(key);
+        while (m_entries[i].object != object) {
+            if (m_entries[i].object == nullptr) {
+                return;
+            }
+
+            i = (i + 1) & (m_capacity - 1);
+        }
+
+        /* Shift later entries of the run back into the hole, so that no tombstones are needed. */
+        for (u32 j = (i + 1) & (m_capacity - 1); m_entries[j].object != nullptr; j = (j + 1) & (m_capacity - 1)) {
+            /* An entry may only move if the hole lies between its home and where it is now. */
+            const u32 home = this->GetHomeIndex(m_entries[j].key);
+            const bool can_move = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+
+            if (can_move) {
+                m_entries[i] = m_entries[j];
+                i = j;
+            }
+        }
+
+        m_entries[i] = {};
+        m_count--;
+    }
+
+    bool PtpObjectNameIndex::Grow() {
+        const u32 new_capacity = m_capacity != 0 ? m_capacity * 2 : InitialCapacity;
+
+        Entry *new_entries = static_cast<Entry *>(std::calloc(new_capacity, sizeof(Entry)));
+        if (new_entries == nullptr) {
+            return false;
+        }
+
+        Entry *old_entries = m_entries;
+        const u32 old_capacity = m_capacity;
+
+        m_entries  = new_entries;
+        m_capacity = new_capacity;
+
+        /* Move every entry to its position in the larger table. */
+        for (u32 i = 0; i < old_capacity; i++) {
+            if (old_entries[i].object == nullptr) {
+                continue;
+            }
+
+            u32 j = this->GetHomeIndex(old_entries[i].key);
+            while (m_entries[j].object != nullptr) {
+                j = (j + 1) & (m_capacity - 1);
+            }
+
+            m_entries[j] = old_entries[i];
+        }
+
+        std::free(old_entries);
+        return true;
+    }
+
+    void PtpObjectIdTable::Initialize() {
+        m_chunks        = nullptr;
+        m_chunk_count   = 0;
+        m_roots         = nullptr;
+        m_root_count    = 0;
+        m_root_capacity = 0;
+    }
+
+    void PtpObjectIdTable::Finalize() {
+        for (u32 i = 0; i < m_chunk_count; i++) {
+            std::free(m_chunks[i]);
+        }
+
+        std::free(m_chunks);
+        std::free(m_roots);
+
+        this->Initialize();
+    }
+
+    PtpObject *PtpObjectIdTable::Find(u32 object_id) const {
+        const Slot *slot = this->FindSlot(object_id);
+        return slot != nullptr ? slot->object : nullptr;
+    }
+
+    PtpObject *PtpObjectIdTable::FindFirstChild(u32 object_id) const {
+        const Slot *slot = this->FindSlot(object_id);
+        return slot != nullptr ? slot->first_child : nullptr;
+    }
+
+    Result PtpObjectIdTable::Insert(PtpObject *object) {
+        const u32 parent_id = object->GetParentId();
+        const bool has_parent = parent_id != PtpGetObjectHandles_RootParent;
+
+        /* Create both slots before touching either, as creating a root slot may move the others. */
+        Slot *slot;
+        if (has_parent) {
+            R_TRY(this->GetSlot(parent_id, std::addressof(slot)));
+        }
+        R_TRY(this->GetSlot(object->GetObjectId(), std::addressof(slot)));
+
+        slot->object = object;
+
+        /* Link the object at the back of its parent's children. */
+        object->m_prev_sibling = nullptr;
+        object->m_next_sibling = nullptr;
+
+        if (has_parent) {
+            this->LinkChild(this->FindSlot(parent_id), object);
+        }
+
+        R_SUCCEED();
+    }
+
+    void PtpObjectIdTable::LinkChild(Slot *parent_slot, PtpObject *object) {
+        object->m_prev_sibling = parent_slot->last_child;
+        object->m_next_sibling = nullptr;
+
+        if (parent_slot->last_child != nullptr) {
+            parent_slot->last_child->m_next_sibling = object;
+        } else {
+            parent_slot->first_child = object;
+        }
+        parent_slot->last_child = object;
+    }
+
+    void PtpObjectIdTable::UnlinkChild(Slot *parent_slot, PtpObject *object) {
+        if (object->m_prev_sibling != nullptr) {
+            object->m_prev_sibling->m_next_sibling = object->m_next_sibling;
+        } else if (parent_slot != nullptr && parent_slot->first_child == object) {
+            parent_slot->first_child = object->m_next_sibling;
+        }
+
+        if (object->m_next_sibling != nullptr) {
+            object->m_next_sibling->m_prev_sibling = object->m_prev_sibling;
+        } else if (parent_slot != nullptr && parent_slot->last_child == object) {
+            parent_slot->last_child = object->m_prev_sibling;
+        }
+
+        object->m_prev_sibling = nullptr;
+        object->m_next_sibling = nullptr;
+    }
+
+    void PtpObjectIdTable::MoveToBack(PtpObject *object) {
+        Slot *parent_slot = this->FindSlot(object->GetParentId());
+        if (parent_slot == nullptr || parent_slot->last_child == object) {
+            return;
+        }
+
+        this->UnlinkChild(parent_slot, object);
+        this->LinkChild(parent_slot, object);
+    }
+
+    void PtpObjectIdTable::Erase(PtpObject *object) {
+        Slot *slot = this->FindSlot(object->GetObjectId());
+        if (slot == nullptr || slot->object != object) {
+            return;
+        }
+
+        /* The slot keeps its children, and root slots keep their ID, so re-registering never needs to allocate. */
+        slot->object = nullptr;
+
+        /* Unlink the object from its parent's children. */
+        this->UnlinkChild(this->FindSlot(object->GetParentId()), object);
+    }
+
+    PtpObjectIdTable::RootEntry *PtpObjectIdTable::FindRootEntry(u32 object_id) const {
+        for (u32 i = 0; i < m_root_count; i++) {
+            if (m_roots[i].object_id == object_id) {
+                return std::addressof(m_roots[i]);
+            }
+        }
+
+        return nullptr;
+    }
+
+    PtpObjectIdTable::Slot *PtpObjectIdTable::FindSlot(u32 object_id) const {
+        if (IsRootObjectId(object_id)) {
+            RootEntry *entry = this->FindRootEntry(object_id);
+            return entry != nullptr ? std::addressof(entry->slot) : nullptr;
+        }
+
+        const u32 chunk_index = object_id >> ChunkShift;
+        if (chunk_index >= m_chunk_count || m_chunks[chunk_index] == nullptr) {
+            return nullptr;
+        }
+
+        return std::addressof(m_chunks[chunk_index]->slots[object_id & (ChunkEntries - 1)]);
+    }
+
+    Result PtpObjectIdTable::GetSlot(u32 object_id, Slot **out_slot) {
+        /* Storage roots are few, so they are searched linearly. */
+        if (IsRootObjectId(object_id)) {
+            RootEntry *entry = this->FindRootEntry(object_id);
+
+            if (entry == nullptr) {
+                /* Grow the side table if needed. */
+                if (m_root_count == m_root_capacity) {
+                    const u32 new_capacity = m_root_capacity != 0 ? m_root_capacity * 2 : InitialRootCount;
+
+                    RootEntry *new_roots = static_cast<RootEntry *>(std::realloc(m_roots, new_capacity * sizeof(RootEntry)));
+                    R_UNLESS(new_roots != nullptr, haze::ResultOutOfMemory());
+
+                    m_roots         = new_roots;
+                    m_root_capacity = new_capacity;
+                }
+
+                entry = std::addressof(m_roots[m_root_count++]);
+                *entry = { .object_id = object_id, .slot = {} };
+            }
+
+            *out_slot = std::addressof(entry->slot);
+            R_SUCCEED();
+        }
+
+        /* Grow the chunk directory if needed. */
+        const u32 chunk_index = object_id >> ChunkShift;
+        if (chunk_index >= m_chunk_count) {
+            const u32 new_count = std::max(chunk_index + 1, m_chunk_count != 0 ? m_chunk_count * 2 : InitialChunkCount);
+
+            Chunk **new_chunks = static_cast<Chunk **>(std::realloc(m_chunks, new_count * sizeof(Chunk *)));
+            R_UNLESS(new_chunks != nullptr, haze::ResultOutOfMemory());
+
+            std::fill(new_chunks + m_chunk_count, new_chunks + new_count, nullptr);
+
+            m_chunks      = new_chunks;
+            m_chunk_count = new_count;
+        }
+
+        /* Allocate the chunk on first use. */
+        if (m_chunks[chunk_index] == nullptr) {
+            m_chunks[chunk_index] = static_cast<Chunk *>(std::calloc(1, sizeof(Chunk)));
+            R_UNLESS(m_chunks[chunk_index] != nullptr, haze::ResultOutOfMemory());
+        }
+
+        *out_slot = std::addressof(m_chunks[chunk_index]->slots[object_id & (ChunkEntries - 1)]);
+        R_SUCCEED();
+    }
+
     void PtpObjectDatabase::Initialize(PtpObjectHeap *object_heap) {
         m_object_heap = object_heap;
         m_object_heap->Initialize();
 
-        std::construct_at(std::addressof(m_name_tree));
-        std::construct_at(std::addressof(m_object_id_tree));
+        m_name_index.Initialize();
+        m_id_table.Initialize();
 
         m_next_object_id = 1;
     }
 
     void PtpObjectDatabase::Finalize() {
-        std::destroy_at(std::addressof(m_object_id_tree));
-        std::destroy_at(std::addressof(m_name_tree));
+        m_id_table.Finalize();
+        m_name_index.Finalize();
 
         m_next_object_id = 0;
 
@@ -37,44 +361,36 @@ namespace haze {
         m_object_heap = nullptr;
     }
 
-    Result PtpObjectDatabase::CreateOrFindObject(const char *parent_name, const char *name, u32 parent_id, u32 storage_id, PtpObject **out_object) {
-        constexpr auto separator = "/";
+    Result PtpObjectDatabase::CreateOrFindObject(const char *name, u32 parent_id, u32 storage_id, PtpObject **out_object) {
+        /* Check if an object with this name already exists. If it does, we can just return it here. */
+        const u32 name_hash = PtpObjectNameIndex::HashName(name);
+        if (auto * const existing = m_name_index.Find(parent_id, name, name_hash); existing != nullptr) {
+            *out_object = existing;
+            R_SUCCEED();
+        }
 
         /* Calculate length of the new name with null terminator. */
-        const size_t parent_name_len = util::Strlen(parent_name);
-        const size_t separator_len   = util::Strlen(separator);
-        const size_t name_len        = util::Strlen(name);
-        const size_t terminator_len  = 1;
-        const size_t alloc_len       = sizeof(PtpObject) + parent_name_len + separator_len + name_len + terminator_len;
+        const size_t name_len       = util::Strlen(name);
+        const size_t terminator_len = 1;
+        const size_t alloc_len      = sizeof(PtpObject) + name_len + terminator_len;
 
         /* Allocate memory for the object. */
         PtpObject * const object = m_object_heap->Allocate<PtpObject>(alloc_len);
         R_UNLESS(object != nullptr, haze::ResultOutOfMemory());
 
-        /* Build the object name. */
-        std::strncpy(object->m_name,                                   parent_name, parent_name_len + terminator_len);
-        std::strncpy(object->m_name + parent_name_len,                 separator,   separator_len + terminator_len);
-        std::strncpy(object->m_name + parent_name_len + separator_len, name,        name_len + terminator_len);
-
-        {
-            /* Ensure we maintain a clean state on failure. */
-            auto guard = SCOPE_GUARD { m_object_heap->Deallocate(object, alloc_len); };
-
-            /* Check if an object with this name already exists. If it does, we can just return it here. */
-            if (auto * const existing = this->GetObjectByName(object->GetName()); existing != nullptr) {
-                *out_object = existing;
-                R_SUCCEED();
-            }
-
-            /* Persist the reference to the object. */
-            guard.Cancel();
-        }
-
+        /* Copy the object name. */
+        std::memcpy(object->m_name, name, name_len + terminator_len);
 
         /* Set object properties. */
-        object->m_parent_id = parent_id;
-        object->m_storage_id = storage_id;
-        object->m_object_id = 0;
+        object->m_parent_id    = parent_id;
+        object->m_storage_id   = storage_id;
+        object->m_object_id    = 0;
+        object->m_name_hash    = name_hash;
+        object->m_generation   = 0;
+        object->m_prev_sibling = nullptr;
+        object->m_next_sibling = nullptr;
+        object->m_listed       = false;
+        object->InvalidateCachedInfo();
 
         /* Set output. */
         *out_object = object;
@@ -83,21 +399,26 @@ namespace haze {
         R_SUCCEED();
     }
 
-    void PtpObjectDatabase::RegisterObject(PtpObject *object, u32 desired_id) {
+    Result PtpObjectDatabase::RegisterObject(PtpObject *object, u32 desired_id) {
         /* If the object is already registered, skip registration. */
-        if (object->GetIsRegistered()) {
-            return;
-        }
+        R_SUCCEED_IF(object->GetIsRegistered());
 
         /* Set desired object ID. */
         if (desired_id == 0) {
             desired_id = m_next_object_id++;
         }
 
-        /* Insert object into trees. */
+        /* Insert object into the name index and ID table, leaving neither holding it on failure. */
         object->Register(desired_id);
-        m_object_id_tree.insert(*object);
-        m_name_tree.insert(*object);
+        ON_RESULT_FAILURE { object->Unregister(); };
+
+        R_TRY(m_name_index.Insert(object));
+        ON_RESULT_FAILURE_2 { m_name_index.Erase(object); };
+
+        R_TRY(m_id_table.Insert(object));
+
+        this->BumpParentGeneration(object);
+        R_SUCCEED();
     }
 
     void PtpObjectDatabase::UnregisterObject(PtpObject *object) {
@@ -106,9 +427,10 @@ namespace haze {
             return;
         }
 
-        /* Remove object from trees. */
-        m_object_id_tree.erase(m_object_id_tree.iterator_to(*object));
-        m_name_tree.erase(m_name_tree.iterator_to(*object));
+        /* Remove object from the ID table and name index. */
+        m_id_table.Erase(object);
+        m_name_index.Erase(object);
+        this->BumpParentGeneration(object);
         object->Unregister();
     }
 
@@ -117,16 +439,48 @@ namespace haze {
         this->UnregisterObject(object);
 
         /* Free the object. */
-        m_object_heap->Deallocate(object, sizeof(PtpObject) + std::strlen(object->GetName()) + 1);
+        m_object_heap->Deallocate(object, sizeof(PtpObject) + std::strlen(object->GetBaseName()) + 1);
     }
 
-    Result PtpObjectDatabase::CreateAndRegisterObjectId(const char *parent_name, const char *name, u32 parent_id, u32 storage_id, u32 *out_object_id) {
+    void PtpObjectDatabase::DeleteObjectTree(PtpObject *object) {
+        /* Walk down to a leaf and delete it, repeating until only the object itself is left. */
+        /* This avoids recursion, so a deep tree can't exhaust the stack. */
+        PtpObject *current = object;
+
+        while (true) {
+            if (PtpObject *child = this->GetFirstChild(current->GetObjectId()); child != nullptr) {
+                current = child;
+                continue;
+            }
+
+            if (current == object) {
+                break;
+            }
+
+            PtpObject *parent = this->GetObjectById(current->GetParentId());
+            this->DeleteObject(current);
+            current = parent;
+        }
+
+        this->DeleteObject(object);
+    }
+
+    void PtpObjectDatabase::SetObjectNameCase(PtpObject *object, const char *name) {
+        /* Names are only folded in ASCII, so a name differing in case alone has the same length and hash. */
+        HAZE_ASSERT(strcasecmp(object->m_name, name) == 0);
+
+        std::memcpy(object->m_name, name, std::strlen(object->m_name));
+    }
+
+    Result PtpObjectDatabase::CreateAndRegisterObjectId(const char *name, u32 parent_id, u32 storage_id, u32 *out_object_id) {
         /* Try to create the object. */
         PtpObject *object;
-        R_TRY(this->CreateOrFindObject(parent_name, name, parent_id, storage_id, std::addressof(object)));
+        R_TRY(this->CreateOrFindObject(name, parent_id, storage_id, std::addressof(object)));
 
         /* We succeeded, so register it. */
-        this->RegisterObject(object);
+        /* Registration can only fail for a new object, which we then free again. */
+        ON_RESULT_FAILURE { this->DeleteObject(object); };
+        R_TRY(this->RegisterObject(object));
 
         /* Set the output ID. */
         *out_object_id = object->GetObjectId();
@@ -135,20 +489,57 @@ namespace haze {
     }
 
     PtpObject *PtpObjectDatabase::GetObjectById(u32 object_id) {
-        /* Find in ID mapping. */
-        if (auto it = m_object_id_tree.find_key(object_id); it != m_object_id_tree.end()) {
-            return std::addressof(*it);
-        } else {
-            return nullptr;
+        /* Find in ID table. */
+        return m_id_table.Find(object_id);
+    }
+
+    void PtpObjectDatabase::BumpParentGeneration(const PtpObject *object) {
+        /* The parent's children have changed, so any listing of it is out of date. */
+        if (PtpObject *parent = this->GetObjectById(object->GetParentId()); parent != nullptr) {
+            parent->BumpGeneration();
         }
     }
 
-    PtpObject *PtpObjectDatabase::GetObjectByName(const char *name) {
-        /* Find in name mapping. */
-        if (auto it = m_name_tree.find_key(name); it != m_name_tree.end()) {
-            return std::addressof(*it);
-        } else {
-            return nullptr;
+    PtpObject *PtpObjectDatabase::GetFirstChild(u32 object_id) {
+        return m_id_table.FindFirstChild(object_id);
+    }
+
+    void PtpObjectDatabase::MoveObjectToBack(PtpObject *object) {
+        m_id_table.MoveToBack(object);
+    }
+
+    PtpObject *PtpObjectDatabase::GetObjectByName(u32 parent_id, const char *name) {
+        /* Find in name index. */
+        return m_name_index.Find(parent_id, name, PtpObjectNameIndex::HashName(name));
+    }
+
+    Result PtpObjectDatabase::GetObjectPath(const PtpObject *object, char *out_path, size_t path_size) {
+        R_UNLESS(path_size > 0, haze::ResultInvalidArgument());
+
+        /* Build the path right to left, prepending a separator and name for each object up to the root. */
+        size_t offset = path_size - 1;
+        out_path[offset] = '\x00';
+
+        while (true) {
+            const char *name = object->GetBaseName();
+            const size_t name_len = std::strlen(name);
+            R_UNLESS(name_len + 1 <= offset, haze::ResultInvalidArgument());
+
+            offset -= name_len;
+            std::memcpy(out_path + offset, name, name_len);
+            out_path[--offset] = '/';
+
+            /* Stop once we reach the storage root. */
+            if (object->GetParentId() == PtpGetObjectHandles_RootParent) {
+                break;
+            }
+
+            /* If a parent was removed, its children no longer have a path. */
+            object = this->GetObjectById(object->GetParentId());
+            R_UNLESS(object != nullptr, haze::ResultInvalidObjectId());
         }
+
+        std::memmove(out_path, out_path + offset, path_size - offset);
+        R_SUCCEED();
     }
 }
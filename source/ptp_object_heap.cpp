@@ -19,16 +19,16 @@ namespace haze {
 
     namespace {
 
-        /* Max heap to allocate. */
+        /* Default heap budget. */
         /* Original Haze allocates the entire heap as there's no reason not to. */
         /* As we are a library, we want to allocate as little as possible. */
-        static constexpr u32 MaxHeapBlock = 20_MB;
+        static constexpr size_t DefaultHeapBudget = 40_MB;
 
     }
 
     void PtpObjectHeap::Initialize() {
-        /* If we're already initialized, skip re-initialization. */
-        if (m_heap_block_size != 0) {
+        /* If we already have a budget, skip re-initialization. */
+        if (m_budget != 0) {
             return;
         }
 
@@ -36,35 +36,51 @@ namespace haze {
         size_t mem_used = 0;
         HAZE_R_ABORT_UNLESS(svcGetInfo(std::addressof(mem_used), InfoType_UsedMemorySize, svc::CurrentProcess, 0));
 
-        /* Calculate size of blocks. */
-        m_heap_block_size = mem_used / NumHeapBlocks;
-        HAZE_ASSERT(m_heap_block_size > 0);
+        /* Calculate the budget. No memory is allocated until the first object is created. */
+        m_budget = std::min(DefaultHeapBudget, mem_used);
+        HAZE_ASSERT(m_budget > 0);
+    }
 
-        /* Allocate the memory. */
-        m_heap_block_size = std::min(MaxHeapBlock, m_heap_block_size);
-        for (size_t i = 0; i < NumHeapBlocks; i++) {
-            m_heap_blocks[i] = std::malloc(m_heap_block_size);
-            HAZE_ASSERT(m_heap_blocks[i] != nullptr);
+    void PtpObjectHeap::Finalize() {
+        /* Release every chunk, allowing a subsequent call to Initialize() if desired. */
+        while (m_current_chunk != nullptr) {
+            HeapChunk *prev = m_current_chunk->prev;
+            std::free(m_current_chunk);
+            m_current_chunk = prev;
         }
 
-        /* Set the address to allocate from. */
-        m_next_address = m_heap_blocks[0];
+        m_next_address = nullptr;
+        m_total_size   = 0;
+
+        /* The free lists point into the chunks, so they are dropped along with them. */
+        std::memset(m_free_lists, 0, sizeof(m_free_lists));
+        m_free_size = 0;
     }
 
-    void PtpObjectHeap::Finalize() {
-        if (m_heap_block_size == 0) {
-            return;
+    bool PtpObjectHeap::AdvanceToNextChunk() {
+        /* Check that another chunk fits in the budget. */
+        if (m_total_size + HeapChunkSize > m_budget) {
+            return false;
+        }
+
+        /* Allocate the chunk. */
+        HeapChunk *chunk = static_cast<HeapChunk *>(std::malloc(HeapChunkSize));
+        if (chunk == nullptr) {
+            return false;
         }
 
-        /* Tear down the heap, allowing a subsequent call to Initialize() if desired. */
-        for (size_t i = 0; i < NumHeapBlocks; i++) {
-            std::free(m_heap_blocks[i]);
-            m_heap_blocks[i] = nullptr;
+        /* Keep the unused tail of the current chunk for later allocations. */
+        if (const size_t tail = this->GetCurrentChunkEnd() - this->GetNextAddress(); tail != 0 && tail <= MaxSizeClassSize) {
+            this->PushFreeList(m_next_address, tail);
         }
 
-        m_next_address       = nullptr;
-        m_heap_block_size    = 0;
-        m_current_heap_block = 0;
+        /* Link the chunk and allocate from it. */
+        chunk->prev     = m_current_chunk;
+        m_current_chunk = chunk;
+        m_next_address  = chunk + 1;
+        m_total_size   += HeapChunkSize;
+
+        return true;
     }
 
 }
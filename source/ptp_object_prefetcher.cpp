@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/ptp_object_prefetcher.hpp>
+#include <haze/thread.hpp>
+
+namespace haze {
+
+    void PtpObjectPrefetcher::Initialize() {
+        mutexInit(std::addressof(m_mutex));
+        condvarInit(std::addressof(m_condvar));
+
+        m_state = State_Idle;
+        m_file_open = false;
+        m_exit = false;
+
+        /* Without the thread, every object is read when it is asked for. */
+        if (R_FAILED(sphaira::utils::CreateThread(std::addressof(m_thread), ThreadFunction, this, 1024*64))) {
+            return;
+        }
+
+        if (R_FAILED(threadStart(std::addressof(m_thread)))) {
+            threadClose(std::addressof(m_thread));
+            return;
+        }
+
+        m_initialized = true;
+    }
+
+    void PtpObjectPrefetcher::Finalize() {
+        if (!m_initialized) {
+            return;
+        }
+
+        {
+            mutexLock(std::addressof(m_mutex));
+            ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+            m_exit = true;
+            m_discard = true;
+            condvarWakeAll(std::addressof(m_condvar));
+        }
+
+        threadWaitForExit(std::addressof(m_thread));
+        threadClose(std::addressof(m_thread));
+
+        /* The thread is gone, so whatever it left behind is ours. */
+        this->DiscardLocked();
+
+        std::free(m_buffer);
+        m_buffer = nullptr;
+        m_initialized = false;
+    }
+
+    void PtpObjectPrefetcher::Start(FileSystemProxyImpl *fs, u32 object_id, const char *path) {
+        if (!m_initialized || std::strlen(path) >= sizeof(m_path)) {
+            return;
+        }
+
+        this->Discard();
+
+        /* The buffer is only needed once something is read ahead, and is kept until we finalize. */
+        if (m_buffer == nullptr) {
+            m_buffer = static_cast<u8 *>(std::malloc(BufferSize));
+            if (m_buffer == nullptr) {
+                return;
+            }
+        }
+
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        std::strcpy(m_path, path);
+        m_fs        = fs;
+        m_object_id = object_id;
+        m_discard   = false;
+        m_state     = State_Pending;
+
+        condvarWakeAll(std::addressof(m_condvar));
+    }
+
+    bool PtpObjectPrefetcher::Take(u32 object_id, FsFile *out_file, s64 *out_file_size, const u8 **out_data, s64 *out_data_size) {
+        if (!m_initialized) {
+            return false;
+        }
+
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        /* A wrong guess is no longer useful, so stop reading it. */
+        if (m_object_id != object_id) {
+            this->DiscardLocked();
+            return false;
+        }
+
+        while (m_state == State_Pending || m_state == State_Reading) {
+            condvarWait(std::addressof(m_condvar), std::addressof(m_mutex));
+        }
+
+        if (m_state != State_Ready || !m_file_open) {
+            this->DiscardLocked();
+            return false;
+        }
+
+        *out_file      = m_file;
+        *out_file_size = m_file_size;
+        *out_data      = m_buffer;
+        *out_data_size = m_data_size;
+
+        /* The file now belongs to the caller. */
+        m_file_open = false;
+        m_state     = State_Idle;
+        return true;
+    }
+
+    void PtpObjectPrefetcher::Discard() {
+        if (!m_initialized) {
+            return;
+        }
+
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        this->DiscardLocked();
+    }
+
+    void PtpObjectPrefetcher::DiscardLocked() {
+        /* Let the thread finish reading, which it gives up on quickly once discarded. */
+        m_discard = true;
+        while (m_state == State_Reading) {
+            condvarWait(std::addressof(m_condvar), std::addressof(m_mutex));
+        }
+
+        if (m_file_open) {
+            m_fs->CloseFile(std::addressof(m_file));
+            m_file_open = false;
+        }
+
+        m_state = State_Idle;
+    }
+
+    bool PtpObjectPrefetcher::IsDiscarded() {
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        return m_discard;
+    }
+
+    Result PtpObjectPrefetcher::ReadAhead() {
+        R_TRY(m_fs->OpenFile(m_path, FsOpenMode_Read, std::addressof(m_file)));
+        ON_RESULT_FAILURE { m_fs->CloseFile(std::addressof(m_file)); };
+
+        R_TRY(m_fs->GetFileSize(std::addressof(m_file), std::addressof(m_file_size)));
+
+        /* Read in small pieces, so that a wrong guess is given up on quickly. */
+        const s64 read_ahead_size = std::min<s64>(m_file_size, BufferSize);
+
+        m_data_size = 0;
+        while (m_data_size < read_ahead_size && !this->IsDiscarded()) {
+            u64 bytes_read;
+            R_TRY(m_fs->ReadFile(std::addressof(m_file), m_data_size, m_buffer + m_data_size, std::min<s64>(ReadSize, read_ahead_size - m_data_size), FsReadOption_None, std::addressof(bytes_read)));
+
+            if (bytes_read == 0) {
+                break;
+            }
+
+            m_data_size += bytes_read;
+        }
+
+        R_SUCCEED();
+    }
+
+    void PtpObjectPrefetcher::ThreadFunction(void *arg) {
+        static_cast<PtpObjectPrefetcher *>(arg)->ThreadFunctionImpl();
+    }
+
+    void PtpObjectPrefetcher::ThreadFunctionImpl() {
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(m_mutex)); };
+
+        while (!m_exit) {
+            switch (m_state) {
+                case State_Pending:
+                    {
+                        /* Nothing else touches the file while we read it. */
+                        m_state = State_Reading;
+
+                        mutexUnlock(std::addressof(m_mutex));
+                        const Result rc = this->ReadAhead();
+                        mutexLock(std::addressof(m_mutex));
+
+                        m_file_open  = R_SUCCEEDED(rc);
+                        m_ready_tick = armGetSystemTick();
+                        m_state      = State_Ready;
+
+                        condvarWakeAll(std::addressof(m_condvar));
+                    }
+                    break;
+                case State_Ready:
+                    {
+                        /* Don't hold the file open for a request that may never come. */
+                        const u64 held_ns = armTicksToNs(armGetSystemTick() - m_ready_tick);
+                        if (m_discard || held_ns >= MaxHoldNs) {
+                            this->DiscardLocked();
+                        } else {
+                            condvarWaitTimeout(std::addressof(m_condvar), std::addressof(m_mutex), MaxHoldNs - held_ns);
+                        }
+                    }
+                    break;
+                default:
+                    condvarWait(std::addressof(m_condvar), std::addressof(m_mutex));
+                    break;
+            }
+        }
+    }
+
+}
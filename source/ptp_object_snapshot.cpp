@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/ptp_object_snapshot.hpp>
+
+namespace haze {
+
+    namespace {
+
+        const PtpObjectSnapshotStorage *FindStorage(const PtpObjectSnapshotStorage *storages, size_t num_storages, u32 storage_id) {
+            for (size_t i = 0; i < num_storages; i++) {
+                if (storages[i].storage_id == storage_id) {
+                    return std::addressof(storages[i]);
+                }
+            }
+
+            return nullptr;
+        }
+
+    }
+
+    Result PtpObjectSnapshot::Save(const char *path, PtpObjectDatabase &db, const PtpDirectoryCache &directory_cache, const PtpObjectSnapshotStorage *storages, size_t num_storages) {
+        /* Remove the old snapshot first, so that its space is not counted when measuring the storages. */
+        std::remove(path);
+
+        FILE *file = std::fopen(path, "wb");
+        R_UNLESS(file != nullptr, haze::ResultSnapshotIoFailed());
+
+        /* Ensure we don't leave a partial snapshot behind on failure. */
+        bool succeeded = false;
+        ON_SCOPE_EXIT {
+            std::fclose(file);
+
+            if (!succeeded) {
+                std::remove(path);
+            }
+        };
+
+        u32 num_objects = 0;
+        db.ForEachObject([&] (const PtpObject *) { num_objects++; });
+
+        /* The header is first written without its magic, so a snapshot cut short is never loaded. */
+        Header header = {
+            .magic          = 0,
+            .version        = Version,
+            .next_object_id = db.GetNextObjectId(),
+            .num_storages   = static_cast<u32>(num_storages),
+            .num_objects    = num_objects,
+            .reserved       = 0,
+        };
+
+        std::fwrite(std::addressof(header), sizeof(header), 1, file);
+
+        /* Reserve space for the storages, which are measured once the file has its final size. */
+        for (size_t i = 0; i < num_storages; i++) {
+            const Storage storage = {};
+            std::fwrite(std::addressof(storage), sizeof(storage), 1, file);
+        }
+
+        /* Write every registered object. */
+        db.ForEachObject([&] (const PtpObject *object) {
+            const char *name = object->GetBaseName();
+
+            u8 flags = 0;
+
+            /* A cached listing is only worth keeping if we can tell on load whether the directory changed. */
+            u64 modified_time = 0;
+            if (directory_cache.Contains(object)) {
+                char object_path[FS_MAX_PATH];
+                const PtpObjectSnapshotStorage *storage = FindStorage(storages, num_storages, object->GetStorageId());
+
+                if (storage != nullptr && R_SUCCEEDED(db.GetObjectPath(object, object_path, sizeof(object_path))) && storage->fs->GetModifiedTime(object_path, std::addressof(modified_time))) {
+                    flags |= ObjectFlag_HasListing;
+                }
+            }
+
+            const Object record = {
+                .object_id     = object->GetObjectId(),
+                .parent_id     = object->GetParentId(),
+                .storage_id    = object->GetStorageId(),
+                .name_length   = static_cast<u16>(std::strlen(name)),
+                .flags         = flags,
+                .reserved      = 0,
+                .modified_time = modified_time,
+            };
+
+            std::fwrite(std::addressof(record), sizeof(record), 1, file);
+            std::fwrite(name, 1, record.name_length, file);
+        });
+
+        R_UNLESS(std::fflush(file) == 0 && !std::ferror(file), haze::ResultSnapshotIoFailed());
+
+        /* Measure the storages, now that writing the snapshot can no longer change them. */
+        R_UNLESS(std::fseek(file, sizeof(Header), SEEK_SET) == 0, haze::ResultSnapshotIoFailed());
+
+        for (size_t i = 0; i < num_storages; i++) {
+            Storage storage = { .storage_id = storages[i].storage_id };
+            R_TRY(storages[i].fs->GetTotalSpace("/", std::addressof(storage.total_space)));
+            R_TRY(storages[i].fs->GetFreeSpace("/", std::addressof(storage.free_space)));
+
+            std::fwrite(std::addressof(storage), sizeof(storage), 1, file);
+        }
+
+        /* Finally, mark the snapshot as complete. */
+        header.magic = Magic;
+        R_UNLESS(std::fseek(file, 0, SEEK_SET) == 0, haze::ResultSnapshotIoFailed());
+        std::fwrite(std::addressof(header), sizeof(header), 1, file);
+
+        R_UNLESS(std::fflush(file) == 0 && !std::ferror(file), haze::ResultSnapshotIoFailed());
+
+        succeeded = true;
+        R_SUCCEED();
+    }
+
+    Result PtpObjectSnapshot::Load(const char *path, PtpObjectDatabase *db, PtpDirectoryCache *directory_cache, const PtpObjectSnapshotStorage *storages, size_t num_storages) {
+        FILE *file = std::fopen(path, "rb");
+        R_UNLESS(file != nullptr, haze::ResultSnapshotIoFailed());
+        ON_SCOPE_EXIT { std::fclose(file); };
+
+        /* Determine the snapshot size. */
+        R_UNLESS(std::fseek(file, 0, SEEK_END) == 0, haze::ResultSnapshotIoFailed());
+        const long size = std::ftell(file);
+        R_UNLESS(size >= static_cast<long>(sizeof(Header)), haze::ResultInvalidSnapshot());
+        std::rewind(file);
+
+        /* Read the whole snapshot at once. */
+        u8 *data = static_cast<u8 *>(std::malloc(size));
+        R_UNLESS(data != nullptr, haze::ResultOutOfMemory());
+        ON_SCOPE_EXIT { std::free(data); };
+
+        R_UNLESS(std::fread(data, 1, size, file) == static_cast<size_t>(size), haze::ResultSnapshotIoFailed());
+
+        const u8 *cur = data;
+        const u8 *end = data + size;
+
+        /* Validate the header. */
+        Header header;
+        std::memcpy(std::addressof(header), cur, sizeof(header));
+        cur += sizeof(header);
+
+        R_UNLESS(header.magic == Magic,         haze::ResultInvalidSnapshot());
+        R_UNLESS(header.version == Version,     haze::ResultInvalidSnapshot());
+        R_UNLESS(header.next_object_id != 0,    haze::ResultInvalidSnapshot());
+        R_UNLESS(static_cast<size_t>(end - cur) >= header.num_storages * sizeof(Storage), haze::ResultInvalidSnapshot());
+
+        /* Determine which storages are unchanged since the snapshot was taken. */
+        std::vector<u32> valid_storage_ids;
+        for (u32 i = 0; i < header.num_storages; i++) {
+            Storage storage;
+            std::memcpy(std::addressof(storage), cur, sizeof(storage));
+            cur += sizeof(storage);
+
+            const PtpObjectSnapshotStorage *current = FindStorage(storages, num_storages, storage.storage_id);
+            if (current == nullptr) {
+                continue;
+            }
+
+            s64 total_space, free_space;
+            if (R_FAILED(current->fs->GetTotalSpace("/", std::addressof(total_space))) || R_FAILED(current->fs->GetFreeSpace("/", std::addressof(free_space)))) {
+                continue;
+            }
+
+            if (total_space == storage.total_space && free_space == storage.free_space) {
+                valid_storage_ids.push_back(storage.storage_id);
+            }
+        }
+
+        const auto IsValidStorage = [&] (u32 storage_id) {
+            return std::find(valid_storage_ids.begin(), valid_storage_ids.end(), storage_id) != valid_storage_ids.end();
+        };
+
+        /* Define helper for walking the object records. */
+        const u8 *objects = cur;
+        const auto ForEachRecord = [&] (auto f) {
+            const u8 *record_cur = objects;
+
+            for (u32 i = 0; i < header.num_objects; i++) {
+                Object record;
+                R_UNLESS(static_cast<size_t>(end - record_cur) >= sizeof(record), haze::ResultInvalidSnapshot());
+                std::memcpy(std::addressof(record), record_cur, sizeof(record));
+                record_cur += sizeof(record);
+
+                char name[FS_MAX_PATH];
+                R_UNLESS(record.name_length < sizeof(name),                               haze::ResultInvalidSnapshot());
+                R_UNLESS(static_cast<size_t>(end - record_cur) >= record.name_length,      haze::ResultInvalidSnapshot());
+                std::memcpy(name, record_cur, record.name_length);
+                name[record.name_length] = '\x00';
+                record_cur += record.name_length;
+
+                R_TRY(f(record, name));
+            }
+
+            R_SUCCEED();
+        };
+
+        /* A storage whose root has a different name is not the storage the snapshot was taken of. */
+        R_TRY(ForEachRecord([&] (const Object &record, const char *name) {
+            if (record.parent_id == PtpGetObjectHandles_RootParent && IsValidStorage(record.storage_id)) {
+                if (std::strcmp(FindStorage(storages, num_storages, record.storage_id)->fs->GetName(), name) != 0) {
+                    std::erase(valid_storage_ids, record.storage_id);
+                }
+            }
+
+            R_SUCCEED();
+        }));
+
+        /* Register the objects of every unchanged storage, with the IDs they had before. */
+        R_TRY(ForEachRecord([&] (const Object &record, const char *name) {
+            R_SUCCEED_IF(!IsValidStorage(record.storage_id));
+
+            /* New IDs must not collide with ones we are restoring. */
+            R_UNLESS(record.object_id != 0, haze::ResultInvalidSnapshot());
+            R_UNLESS(record.object_id < header.next_object_id || record.parent_id == PtpGetObjectHandles_RootParent, haze::ResultInvalidSnapshot());
+
+            PtpObject *object;
+            R_TRY(db->CreateOrFindObject(name, record.parent_id, record.storage_id, std::addressof(object)));
+            R_TRY(db->RegisterObject(object, record.object_id));
+
+            R_SUCCEED();
+        }));
+
+        /* Restore the listings of directories that haven't changed, now that registering their children won't bump their generation. */
+        R_TRY(ForEachRecord([&] (const Object &record, const char *name) {
+            R_SUCCEED_IF(!IsValidStorage(record.storage_id) || !(record.flags & ObjectFlag_HasListing));
+
+            const PtpObject *object = db->GetObjectById(record.object_id);
+            R_UNLESS(object != nullptr, haze::ResultInvalidSnapshot());
+
+            char object_path[FS_MAX_PATH];
+            R_TRY(db->GetObjectPath(object, object_path, sizeof(object_path)));
+
+            u64 modified_time;
+            if (FindStorage(storages, num_storages, record.storage_id)->fs->GetModifiedTime(object_path, std::addressof(modified_time)) && modified_time == record.modified_time) {
+                directory_cache->Store(object);
+            }
+
+            R_SUCCEED();
+        }));
+
+        db->SetNextObjectId(header.next_object_id);
+        R_SUCCEED();
+    }
+
+}
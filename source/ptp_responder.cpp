@@ -27,6 +27,13 @@ namespace haze {
             return std::addressof(buffers);
         }
 
+        struct PtpUsbEventContainer {
+            PtpUsbBulkContainer header;
+            u32 param;
+        };
+
+        static_assert(sizeof(PtpUsbEventContainer) == sizeof(PtpUsbBulkContainer) + sizeof(u32));
+
         const char* FixName(const char* name) {
             if (name[0] == '/' && name[1] == '/') {
                 return name + 1;
@@ -36,8 +43,12 @@ namespace haze {
 
     }
 
-    Result PtpResponder::Initialize(EventReactor *reactor, PtpObjectHeap *object_heap, const FsEntries& entries, u16 vid, u16 pid) {
+    Result PtpResponder::Initialize(EventReactor *reactor, PtpObjectHeap *object_heap, Transport *transport, PtpEventQueue *event_queue, const FsEntries& entries, const char *snapshot_path) {
+        m_reactor = reactor;
+        m_snapshot_path = snapshot_path;
         m_object_heap = object_heap;
+        m_transport = transport;
+        m_event_queue = event_queue;
         m_buffers = GetBuffers();
         m_fs_entries.clear();
 
@@ -48,12 +59,28 @@ namespace haze {
             storage_id--;
         }
 
-        /* Configure fs proxy. */
-        R_RETURN(m_usb_server.Initialize(std::addressof(MtpInterfaceInfo), vid, pid, reactor));
+        /* Anything posted before we started can't refer to a session. */
+        m_event_queue->Clear();
+
+        /* Wake up to send events while waiting for the host. */
+        R_UNLESS(m_reactor->AddConsumer(this, m_event_queue->GetWaiter()), haze::ResultRegistrationFailed());
+
+        /* Read files ahead of the host asking for them. */
+        m_prefetcher.Initialize();
+
+        R_SUCCEED();
     }
 
     void PtpResponder::Finalize() {
-        m_usb_server.Finalize();
+        /* Save and release the database of a session the host never closed. */
+        this->ForceCloseSession();
+
+        m_prefetcher.Finalize();
+        m_reactor->RemoveConsumer(this);
+
+        /* The transport is owned by the caller, and outlives us. */
+        m_transport = nullptr;
+        m_event_queue = nullptr;
     }
 
     Result PtpResponder::LoopProcess() {
@@ -70,6 +97,9 @@ namespace haze {
                 }
             } R_END_TRY_CATCH;
 
+            /* Send anything posted while the request was in progress. */
+            this->SendPendingEvents();
+
             /* Otherwise, handle the next request. */
             /* ... */
         }
@@ -82,6 +112,16 @@ namespace haze {
         };
 
         R_TRY_CATCH(this->HandleRequestImpl()) {
+            R_CATCH(haze::ResultCancelled) {
+                /* The host doesn't expect a response to a cancelled transaction. */
+                /* It polls the device status instead, which reports busy until we reset the token. */
+                m_reactor->GetCancelToken()->Reset();
+            }
+            R_CATCH(haze::ResultDeviceReset) {
+                /* The host expects no session to be open after a reset, nor a response. */
+                this->ForceCloseSession();
+                m_reactor->GetCancelToken()->Reset();
+            }
             R_CATCH(haze::ResultUnknownRequestType) {
                 R_TRY(this->WriteResponse(PtpResponseCode_GeneralError));
             }
@@ -122,8 +162,15 @@ namespace haze {
     }
 
     Result PtpResponder::HandleRequestImpl() {
-        PtpDataParser dp(m_buffers->usb_bulk_read_buffer, std::addressof(m_usb_server));
-        R_TRY(dp.Read(std::addressof(m_request_header)));
+        PtpDataParser dp(m_transport);
+
+        {
+            /* Until the next request arrives, events can be sent as soon as they are posted. */
+            m_idle = true;
+            ON_SCOPE_EXIT { m_idle = false; };
+
+            R_TRY(dp.Read(std::addressof(m_request_header)));
+        }
 
         switch (m_request_header.type) {
             case PtpUsbBulkContainerType_Command: R_RETURN(this->HandleCommandRequest(dp));
@@ -136,6 +183,24 @@ namespace haze {
             R_THROW(haze::ResultSessionNotOpen());
         }
 
+        /* A file read ahead may be changed by anything but another read, so throw it away. */
+        switch (m_request_header.code) {
+            case PtpOperationCode_GetDeviceInfo:
+            case PtpOperationCode_GetStorageIds:
+            case PtpOperationCode_GetStorageInfo:
+            case PtpOperationCode_GetObjectHandles:
+            case PtpOperationCode_GetObjectInfo:
+            case PtpOperationCode_GetObject:
+            case PtpOperationCode_MtpGetObjectPropsSupported:
+            case PtpOperationCode_MtpGetObjectPropDesc:
+            case PtpOperationCode_MtpGetObjectPropValue:
+            case PtpOperationCode_MtpGetObjPropList:
+                break;
+            default:
+                m_prefetcher.Discard();
+                break;
+        }
+
         switch (m_request_header.code) {
             case PtpOperationCode_GetDeviceInfo:              R_RETURN(this->GetDeviceInfo(dp));           break;
             case PtpOperationCode_OpenSession:                R_RETURN(this->OpenSession(dp));             break;
@@ -161,22 +226,242 @@ namespace haze {
         }
     }
 
+    Result PtpResponder::GetObjectEntryInfo(PtpObject *obj, FsDirEntryType *out_entry_type, s64 *out_size) {
+        /* Most objects were seen in a directory listing, which told us everything we need. */
+        R_SUCCEED_IF(obj->GetCachedInfo(out_entry_type, out_size));
+
+        const char *path;
+        R_TRY(this->GetObjectPath(obj, std::addressof(path)));
+
+        /* Figure out what type of object this is. */
+        FsDirEntryType entry_type;
+        R_TRY(Fs(obj).GetEntryType(path, std::addressof(entry_type)));
+
+        /* Get the size, if this is a file. */
+        s64 size = 0;
+        if (entry_type == FsDirEntryType_File) {
+            FsFile file;
+            R_TRY(Fs(obj).OpenFile(path, FsOpenMode_Read, std::addressof(file)));
+
+            /* Ensure we maintain a clean state on exit. */
+            ON_SCOPE_EXIT { Fs(obj).CloseFile(std::addressof(file)); };
+
+            R_TRY(Fs(obj).GetFileSize(std::addressof(file), std::addressof(size)));
+        }
+
+        obj->SetCachedInfo(entry_type, size);
+
+        *out_entry_type = entry_type;
+        *out_size       = size;
+        R_SUCCEED();
+    }
+
+    void PtpResponder::PrefetchNextObject(const PtpObject *obj) {
+        /* Hosts copying a folder usually ask for its files in the order they were listed, so guess the next one. */
+        /* Siblings are kept in the order GetObjectHandles last sent them, whether or not it was answered from the cache. */
+        for (const PtpObject *next = obj->GetNextSibling(); next != nullptr; next = next->GetNextSibling()) {
+            /* Only guess objects known to be files, without asking the filesystem. */
+            FsDirEntryType entry_type;
+            s64 size;
+            if (!next->GetCachedInfo(std::addressof(entry_type), std::addressof(size))) {
+                return;
+            }
+
+            if (entry_type != FsDirEntryType_File) {
+                continue;
+            }
+
+            /* The file is read on another thread, which the filesystem must allow. */
+            if (!Fs(next).MultiThreadTransfer(size, true)) {
+                return;
+            }
+
+            /* The first path buffer still holds the path of the object being sent. */
+            const char *path;
+            if (R_FAILED(this->GetObjectPath(next, std::addressof(path), 1))) {
+                return;
+            }
+
+            m_prefetcher.Start(std::addressof(Fs(next)), next->GetObjectId(), path);
+            return;
+        }
+    }
+
     void PtpResponder::ForceCloseSession() {
         if (m_session_open) {
             m_session_open = false;
+            m_prefetcher.Discard();
+            this->SaveSnapshot();
+            m_directory_cache.Finalize();
             m_object_database.Finalize();
         }
     }
 
+    std::vector<PtpObjectSnapshotStorage> PtpResponder::GetSnapshotStorages() const {
+        std::vector<PtpObjectSnapshotStorage> storages;
+
+        for (const auto& e : m_fs_entries) {
+            storages.push_back({ .storage_id = e.storage_id, .fs = e.impl.get() });
+        }
+
+        return storages;
+    }
+
+    void PtpResponder::LoadSnapshot() {
+        if (m_snapshot_path == nullptr) {
+            return;
+        }
+
+        /* If the snapshot can't be used, start again from an empty database. */
+        const auto storages = this->GetSnapshotStorages();
+        if (R_FAILED(PtpObjectSnapshot::Load(m_snapshot_path, std::addressof(m_object_database), std::addressof(m_directory_cache), storages.data(), storages.size()))) {
+            m_directory_cache.Finalize();
+            m_directory_cache.Initialize();
+            m_object_database.Finalize();
+            m_object_database.Initialize(m_object_heap);
+        }
+    }
+
+    void PtpResponder::SaveSnapshot() {
+        if (m_snapshot_path == nullptr) {
+            return;
+        }
+
+        /* A failed save only means the next session starts from an empty database. */
+        const auto storages = this->GetSnapshotStorages();
+        PtpObjectSnapshot::Save(m_snapshot_path, m_object_database, m_directory_cache, storages.data(), storages.size());
+    }
+
+    void PtpResponder::ProcessEvent() {
+        /* Sending an event may modify the database, which a request in progress could be using. */
+        /* If we are busy, the events will instead be sent once the request completes. */
+        if (m_idle) {
+            this->SendPendingEvents();
+        }
+    }
+
+    void PtpResponder::SendPendingEvents() {
+        /* Without a session, the host has no object handles that could be out of date. */
+        if (!m_session_open) {
+            m_event_queue->Clear();
+            return;
+        }
+
+        PtpEvent event;
+        while (m_event_queue->Peek(std::addressof(event))) {
+            /* If the host hasn't collected the last event yet, try again later. */
+            /* Sending an event is idempotent, so it is safe to retry. */
+            if (haze::ResultTransferBusy::Includes(this->SendEvent(event))) {
+                break;
+            }
+
+            /* Otherwise, the event was either sent or could not be sent at all. */
+            m_event_queue->Pop();
+        }
+    }
+
+    Result PtpResponder::SendEvent(const PtpEvent &event) {
+        PtpObject *obj;
+
+        if (event.fs == nullptr) {
+            /* The responder posted an event for a known object. */
+            obj = m_object_database.GetObjectById(event.object_id);
+        } else {
+            /* The application posted an event for a path, so walk to it from the storage root. */
+            /* It may have changed the file we read ahead. */
+            m_prefetcher.Discard();
+
+            const FsEntry *entry = this->FindFsEntry(event.fs);
+            R_UNLESS(entry != nullptr, haze::ResultInvalidArgument());
+
+            char path[FS_MAX_PATH];
+            std::strcpy(path, event.path);
+
+            PtpObject *parent = nullptr;
+            const char *base_name = nullptr;
+            obj = m_object_database.GetObjectById(entry->storage_id);
+
+            char *save_ptr;
+            for (char *component = strtok_r(path, "/", std::addressof(save_ptr)); component != nullptr; component = strtok_r(nullptr, "/", std::addressof(save_ptr))) {
+                /* If a directory on the way is unknown, so is everything below it. */
+                if (obj == nullptr) {
+                    parent = nullptr;
+                    break;
+                }
+
+                parent    = obj;
+                base_name = component;
+                obj       = m_object_database.GetObjectByName(parent->GetObjectId(), component);
+            }
+
+            /* Events for the storage root itself are not reported. */
+            R_SUCCEED_IF(base_name == nullptr);
+
+            /* New objects are only of interest if the host can see their parent. */
+            if (obj == nullptr && parent != nullptr && event.type == NotifyType_Created) {
+                u32 object_id;
+                R_TRY(m_object_database.CreateAndRegisterObjectId(base_name, parent->GetObjectId(), entry->storage_id, std::addressof(object_id)));
+                obj = m_object_database.GetObjectById(object_id);
+            }
+        }
+
+        /* If the host has never seen the object, there is nothing to tell it. */
+        R_SUCCEED_IF(obj == nullptr);
+
+        /* Whatever we knew about the object may no longer be true. */
+        obj->InvalidateCachedInfo();
+
+        switch (event.type) {
+            case NotifyType_Created:
+                R_RETURN(this->SendEventPacket(PtpEventCode_ObjectAdded, obj->GetObjectId()));
+            case NotifyType_Removed:
+                /* The storage roots can't be removed. */
+                R_SUCCEED_IF(obj->GetParentId() == PtpGetObjectHandles_RootParent);
+
+                /* Only forget the object once the host has been told, so a retry can find it again. */
+                R_TRY(this->SendEventPacket(PtpEventCode_ObjectRemoved, obj->GetObjectId()));
+                m_object_database.DeleteObjectTree(obj);
+                R_SUCCEED();
+            case NotifyType_Changed:
+                R_RETURN(this->SendEventPacket(PtpEventCode_ObjectInfoChanged, obj->GetObjectId()));
+            default:
+                R_THROW(haze::ResultInvalidArgument());
+        }
+    }
+
+    Result PtpResponder::SendEventPacket(PtpEventCode code, u32 param) {
+        const PtpUsbEventContainer container = {
+            .header = {
+                .length   = sizeof(PtpUsbEventContainer),
+                .type     = PtpUsbBulkContainerType_Event,
+                .code     = code,
+                .trans_id = m_request_header.trans_id,
+            },
+            .param = param,
+        };
+
+        R_RETURN(m_transport->SendInterruptPacket(std::addressof(container), sizeof(container)));
+    }
+
+    const FsEntry *PtpResponder::FindFsEntry(const FileSystemProxyImpl *fs) const {
+        for (const auto &e : m_fs_entries) {
+            if (e.impl.get() == fs) {
+                return std::addressof(e);
+            }
+        }
+
+        return nullptr;
+    }
+
     Result PtpResponder::WriteResponse(PtpResponseCode code, const void* data, size_t size) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
         R_TRY(db.AddResponseHeader(m_request_header, code, size));
         R_TRY(db.AddBuffer(reinterpret_cast<const u8*>(data), size));
         R_RETURN(db.Commit());
     }
 
     Result PtpResponder::WriteResponse(PtpResponseCode code) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
         R_TRY(db.AddResponseHeader(m_request_header, code, 0));
         R_RETURN(db.Commit());
     }
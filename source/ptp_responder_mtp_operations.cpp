@@ -23,7 +23,7 @@ namespace haze {
     Result PtpResponder::GetObjectPropsSupported(PtpDataParser &dp) {
         R_TRY(dp.Finalize());
 
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         /* Write information about all object properties we can support. */
         R_TRY(db.WriteVariableLengthData(m_request_header, [&] {
@@ -46,7 +46,7 @@ namespace haze {
         R_UNLESS(IsSupportedObjectPropertyCode(property_code), haze::ResultUnknownPropertyCode());
 
         /* Begin writing information about the property code. */
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         R_TRY(db.WriteVariableLengthData(m_request_header, [&] {
             R_TRY(db.Add(property_code));
@@ -130,32 +130,18 @@ namespace haze {
 
         /* Define helper for getting the object type. */
         const auto GetObjectType = [&] (FsDirEntryType *out_entry_type) {
-            R_RETURN(Fs(obj).GetEntryType(obj->GetName(), out_entry_type));
+            s64 size;
+            R_RETURN(this->GetObjectEntryInfo(obj, out_entry_type, std::addressof(size)));
         };
 
         /* Define helper for getting the object size. */
         const auto GetObjectSize = [&] (s64 *out_size) {
-            *out_size = 0;
-
-            /* Check if this is a directory. */
             FsDirEntryType entry_type;
-            R_TRY(GetObjectType(std::addressof(entry_type)));
-
-            /* If it is, we're done. */
-            R_SUCCEED_IF(entry_type == FsDirEntryType_Dir);
-
-            /* Otherwise, open as a file. */
-            FsFile file;
-            R_TRY(Fs(obj).OpenFile(obj->GetName(), FsOpenMode_Read, std::addressof(file)));
-
-            /* Ensure we maintain a clean state on exit. */
-            ON_SCOPE_EXIT { Fs(obj).CloseFile(std::addressof(file)); };
-
-            R_RETURN(Fs(obj).GetFileSize(std::addressof(file), out_size));
+            R_RETURN(this->GetObjectEntryInfo(obj, std::addressof(entry_type), out_size));
         };
 
         /* Begin writing the requested object property. */
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         R_TRY(db.WriteVariableLengthData(m_request_header, [&] {
             switch (property_code) {
@@ -190,7 +176,7 @@ namespace haze {
                     break;
                 case PtpObjectPropertyCode_ObjectFileName:
                     {
-                        R_TRY(db.AddString(std::strrchr(obj->GetName(), '/') + 1));
+                        R_TRY(db.AddString(obj->GetBaseName()));
                     }
                     break;
                 HAZE_UNREACHABLE_DEFAULT_CASE();
@@ -235,28 +221,14 @@ namespace haze {
 
         /* Define helper for getting the object type. */
         const auto GetObjectType = [&] (FsDirEntryType *out_entry_type) {
-            R_RETURN(Fs(obj).GetEntryType(obj->GetName(), out_entry_type));
+            s64 size;
+            R_RETURN(this->GetObjectEntryInfo(obj, out_entry_type, std::addressof(size)));
         };
 
         /* Define helper for getting the object size. */
         const auto GetObjectSize = [&] (s64 *out_size) {
-            *out_size = 0;
-
-            /* Check if this is a directory. */
             FsDirEntryType entry_type;
-            R_TRY(GetObjectType(std::addressof(entry_type)));
-
-            /* If it is, we're done. */
-            R_SUCCEED_IF(entry_type == FsDirEntryType_Dir);
-
-            /* Otherwise, open as a file. */
-            FsFile file;
-            R_TRY(Fs(obj).OpenFile(obj->GetName(), FsOpenMode_Read, std::addressof(file)));
-
-            /* Ensure we maintain a clean state on exit. */
-            ON_SCOPE_EXIT { Fs(obj).CloseFile(std::addressof(file)); };
-
-            R_RETURN(Fs(obj).GetFileSize(std::addressof(file), out_size));
+            R_RETURN(this->GetObjectEntryInfo(obj, std::addressof(entry_type), out_size));
         };
 
         /* Define helper for determining if the property should be included. */
@@ -274,7 +246,7 @@ namespace haze {
         }
 
         /* Begin writing the requested object properties. */
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         R_TRY(db.WriteVariableLengthData(m_request_header, [&] {
             /* Report the number of elements. */
@@ -330,7 +302,7 @@ namespace haze {
                     case PtpObjectPropertyCode_ObjectFileName:
                         {
                             R_TRY(db.Add(PtpDataTypeCode_String));
-                            R_TRY(db.AddString(std::strrchr(obj->GetName(), '/') + 1));
+                            R_TRY(db.AddString(obj->GetBaseName()));
                         }
                         break;
                     HAZE_UNREACHABLE_DEFAULT_CASE();
@@ -370,7 +342,7 @@ namespace haze {
         auto * const parentobj = m_object_database.GetObjectById(parent_object);
         R_UNLESS(parentobj != nullptr, haze::ResultInvalidObjectId());
 
-        PtpDataParser dp(m_buffers->usb_bulk_read_buffer, std::addressof(m_usb_server));
+        PtpDataParser dp(m_transport);
 
         /* Ensure we have a data header. */
         PtpUsbBulkContainer data_header;
@@ -416,7 +388,7 @@ namespace haze {
 
         /* Add a new object in the database with the new name. */
         PtpObject *newobj;
-        R_TRY(m_object_database.CreateOrFindObject(parentobj->GetName(), m_buffers->filename_string_buffer, parentobj->GetObjectId(), parentobj->GetStorageId(), std::addressof(newobj)));
+        R_TRY(m_object_database.CreateOrFindObject(m_buffers->filename_string_buffer, parentobj->GetObjectId(), parentobj->GetStorageId(), std::addressof(newobj)));
 
         /* Create prop list. */
         ObjectPropList prop_list{};
@@ -432,13 +404,17 @@ namespace haze {
         ON_RESULT_FAILURE { m_object_database.DeleteObject(newobj); };
 
         /* Register the object with a new ID. */
-        m_object_database.RegisterObject(newobj);
+        R_TRY(m_object_database.RegisterObject(newobj));
         new_object_info.object_id = newobj->GetObjectId();
 
+        const char *path;
+        R_TRY(this->GetObjectPath(newobj, std::addressof(path)));
+
         /* Create the object on the filesystem. */
         if (format_code == PtpObjectFormatCode_Association) {
-            R_TRY(Fs(newobj).CreateDirectory(newobj->GetName()));
-            WriteCallbackFile(CallbackType_CreateFolder, newobj->GetName());
+            R_TRY(Fs(newobj).CreateDirectory(path));
+            newobj->SetCachedInfo(FsDirEntryType_Dir, 0);
+            WriteCallbackFile(CallbackType_CreateFolder, path);
             m_send_object_id = 0;
         } else {
             u32 flags = 0;
@@ -446,8 +422,9 @@ namespace haze {
                 flags = FsCreateOption_BigFile;
             }
 
-            R_TRY(Fs(newobj).CreateFile(newobj->GetName(), prop_list.size, flags));
-            WriteCallbackFile(CallbackType_CreateFile, newobj->GetName());
+            R_TRY(Fs(newobj).CreateFile(path, prop_list.size, flags));
+            newobj->SetCachedInfo(FsDirEntryType_File, prop_list.size);
+            WriteCallbackFile(CallbackType_CreateFile, path);
             m_send_object_id = new_object_info.object_id;
         }
 
@@ -464,7 +441,7 @@ namespace haze {
         R_TRY(rdp.Read(std::addressof(property_code)));
         R_TRY(rdp.Finalize());
 
-        PtpDataParser dp(m_buffers->usb_bulk_read_buffer, std::addressof(m_usb_server));
+        PtpDataParser dp(m_transport);
 
         /* Ensure we have a data header. */
         PtpUsbBulkContainer data_header;
@@ -489,18 +466,46 @@ namespace haze {
         const bool contains_slashes = std::strchr(m_buffers->filename_string_buffer, '/') != nullptr;
         R_UNLESS(!is_empty && !contains_slashes, haze::ResultInvalidPropertyValue());
 
+        /* Renames the object on the filesystem. */
+        const auto rename_path = [&](const char *old_path, const char *new_path) -> Result {
+            /* Get the old object type. */
+            FsDirEntryType entry_type;
+            R_TRY(Fs(obj).GetEntryType(old_path, std::addressof(entry_type)));
+
+            /* Attempt to rename the object on the filesystem. */
+            if (entry_type == FsDirEntryType_Dir) {
+                R_TRY(Fs(obj).RenameDirectory(old_path, new_path));
+                WriteCallbackRename(CallbackType_RenameFolder, old_path, new_path);
+            } else {
+                R_TRY(Fs(obj).RenameFile(old_path, new_path));
+                WriteCallbackRename(CallbackType_RenameFile, old_path, new_path);
+            }
+
+            R_SUCCEED();
+        };
+
         /* Add a new object in the database with the new name. */
+        /* Children reference the object by id, so they follow the rename without being touched. */
         PtpObject *newobj;
-        {
-            /* Find the last path separator in the existing object name. */
-            char *pathsep = std::strrchr(obj->m_name, '/');
-            HAZE_ASSERT(pathsep != nullptr);
+        R_TRY(m_object_database.CreateOrFindObject(m_buffers->filename_string_buffer, obj->GetParentId(), obj->GetStorageId(), std::addressof(newobj)));
 
-            /* Temporarily mark the path separator as null to facilitate processing. */
-            *pathsep = '\x00';
-            ON_SCOPE_EXIT { *pathsep = '/'; };
+        /* A change of case alone finds the object itself, which is then renamed where it is. */
+        if (newobj == obj) {
+            if (std::strcmp(obj->GetBaseName(), m_buffers->filename_string_buffer) != 0) {
+                const char *old_path, *new_path;
+                R_TRY(this->GetObjectPath(obj, std::addressof(old_path), 0));
 
-            R_TRY(m_object_database.CreateOrFindObject(obj->GetName(), m_buffers->filename_string_buffer, obj->GetParentId(), obj->GetStorageId(), std::addressof(newobj)));
+                /* The old name ends the old path, and is put back from there on failure. */
+                const char *old_name = old_path + std::strlen(old_path) - std::strlen(obj->GetBaseName());
+                m_object_database.SetObjectNameCase(obj, m_buffers->filename_string_buffer);
+                ON_RESULT_FAILURE { m_object_database.SetObjectNameCase(obj, old_name); };
+
+                R_TRY(this->GetObjectPath(obj, std::addressof(new_path), 1));
+                R_TRY(rename_path(old_path, new_path));
+            }
+
+            /* Write the success response. */
+            R_RETURN(this->WriteResponse(PtpResponseCode_Ok));
         }
 
         {
@@ -513,17 +518,20 @@ namespace haze {
                 }
             };
 
-            /* Get the old object type. */
-            FsDirEntryType entry_type;
-            R_TRY(Fs(obj).GetEntryType(obj->GetName(), std::addressof(entry_type)));
+            /* Build the old and new paths. */
+            const char *old_path, *new_path;
+            R_TRY(this->GetObjectPath(obj, std::addressof(old_path), 0));
+            R_TRY(this->GetObjectPath(newobj, std::addressof(new_path), 1));
 
-            /* Attempt to rename the object on the filesystem. */
-            if (entry_type == FsDirEntryType_Dir) {
-                R_TRY(Fs(obj).RenameDirectory(obj->GetName(), newobj->GetName()));
-                WriteCallbackRename(CallbackType_RenameFolder, obj->GetName(), newobj->GetName());
-            } else {
-                R_TRY(Fs(obj).RenameFile(obj->GetName(), newobj->GetName()));
-                WriteCallbackRename(CallbackType_RenameFile, obj->GetName(), newobj->GetName());
+            R_TRY(rename_path(old_path, new_path));
+        }
+
+        /* The renamed object is the same file or directory as before. */
+        {
+            FsDirEntryType entry_type;
+            s64 size;
+            if (obj->GetCachedInfo(std::addressof(entry_type), std::addressof(size))) {
+                newobj->SetCachedInfo(entry_type, size);
             }
         }
 
@@ -531,7 +539,8 @@ namespace haze {
         m_object_database.DeleteObject(obj);
 
         /* Register the new object. */
-        m_object_database.RegisterObject(newobj, object_id);
+        /* It takes over the old object's ID slot, so this does not allocate. */
+        R_TRY(m_object_database.RegisterObject(newobj, object_id));
 
         /* Write the success response. */
         R_RETURN(this->WriteResponse(PtpResponseCode_Ok));
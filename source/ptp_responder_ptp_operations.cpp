@@ -22,7 +22,7 @@
 namespace haze {
 
     Result PtpResponder::GetDeviceInfo(PtpDataParser &dp) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         /* Write the device info data. */
         R_TRY(db.WriteVariableLengthData(m_request_header, [&] () {
@@ -57,6 +57,10 @@ namespace haze {
         /* Initialize the database. */
         m_session_open = true;
         m_object_database.Initialize(m_object_heap);
+        m_directory_cache.Initialize();
+
+        /* Restore the objects of the previous session, so the host keeps its handles. */
+        this->LoadSnapshot();
 
         /* Create the root storages. */
         for (const auto& fs : m_fs_entries) {
@@ -64,10 +68,10 @@ namespace haze {
             const auto storage_id = fs.storage_id;
 
             PtpObject *object;
-            R_TRY(m_object_database.CreateOrFindObject("", name, PtpGetObjectHandles_RootParent, storage_id, std::addressof(object)));
+            R_TRY(m_object_database.CreateOrFindObject(name, PtpGetObjectHandles_RootParent, storage_id, std::addressof(object)));
 
             /* Register the root storages. */
-            m_object_database.RegisterObject(object, storage_id);
+            R_TRY(m_object_database.RegisterObject(object, storage_id));
         }
 
         WriteCallbackSession(CallbackType_OpenSession);
@@ -90,7 +94,7 @@ namespace haze {
     Result PtpResponder::GetStorageIds(PtpDataParser &dp) {
         R_TRY(dp.Finalize());
 
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         std::vector<u32> storage_ids;
         for (const auto& e : m_fs_entries) {
@@ -107,7 +111,7 @@ namespace haze {
     }
 
     Result PtpResponder::GetStorageInfo(PtpDataParser &dp) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
         PtpStorageInfo storage_info(DefaultStorageInfo);
 
         /* Get the storage ID the client requested information for. */
@@ -148,7 +152,7 @@ namespace haze {
     }
 
     Result PtpResponder::GetObjectHandles(PtpDataParser &dp) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         /* Get the object ID the client requested enumeration for. */
         u32 storage_id, object_format_code, association_object_handle;
@@ -171,9 +175,30 @@ namespace haze {
         auto * const obj = m_object_database.GetObjectById(association_object_handle);
         R_UNLESS(obj != nullptr, haze::ResultInvalidObjectId());
 
+        /* If we listed the directory recently, and nothing in it has changed, its children are what we found. */
+        if (m_directory_cache.Find(obj)) {
+            u32 child_count = 0;
+            for (const PtpObject *child = m_object_database.GetFirstChild(obj->GetObjectId()); child != nullptr; child = child->GetNextSibling()) {
+                child_count++;
+            }
+
+            R_TRY(db.AddDataHeader(m_request_header, sizeof(u32) + (child_count * sizeof(u32))));
+            R_TRY(db.Add(child_count));
+
+            for (const PtpObject *child = m_object_database.GetFirstChild(obj->GetObjectId()); child != nullptr; child = child->GetNextSibling()) {
+                R_TRY(db.Add(child->GetObjectId()));
+            }
+
+            R_TRY(db.Commit());
+            R_RETURN(this->WriteResponse(PtpResponseCode_Ok));
+        }
+
         /* Try to read the object as a directory. */
+        const char *path;
+        R_TRY(this->GetObjectPath(obj, std::addressof(path)));
+
         FsDir dir;
-        R_TRY(Fs(obj).OpenDirectory(obj->GetName(), FsDirOpenMode_ReadDirs | FsDirOpenMode_ReadFiles, std::addressof(dir)));
+        R_TRY(Fs(obj).OpenDirectory(path, FsDirOpenMode_ReadDirs | FsDirOpenMode_ReadFiles, std::addressof(dir)));
 
         /* Ensure we maintain a clean state on exit. */
         ON_SCOPE_EXIT { Fs(obj).CloseDirectory(std::addressof(dir)); };
@@ -189,6 +214,7 @@ namespace haze {
         /* Enumerate the directory, writing results to the data builder as we progress. */
         /* TODO: How should we handle the directory contents changing during enumeration? */
         /* Is this even feasible to handle? */
+        s64 listed_count = 0;
         while (true) {
             /* Get the next batch. */
             s64 read_count = 0;
@@ -196,11 +222,20 @@ namespace haze {
 
             /* Write to output. */
             for (s64 i = 0; i < read_count; i++) {
-                const char *name = m_buffers->file_system_entry_buffer[i].name;
+                const FsDirectoryEntry &entry = m_buffers->file_system_entry_buffer[i];
                 u32 handle;
 
-                R_TRY(m_object_database.CreateAndRegisterObjectId(obj->GetName(), name, obj->GetObjectId(), obj->GetStorageId(), std::addressof(handle)));
+                R_TRY(m_object_database.CreateAndRegisterObjectId(entry.name, obj->GetObjectId(), obj->GetStorageId(), std::addressof(handle)));
                 R_TRY(db.Add(handle));
+
+                /* Remember the type and size, which the host will ask for next. */
+                PtpObject *child = m_object_database.GetObjectById(handle);
+                child->SetCachedInfo(static_cast<FsDirEntryType>(entry.type), entry.file_size);
+                child->SetIsListed(true);
+                listed_count++;
+
+                /* Keep the children in the order we sent them, so that a cached listing matches this one. */
+                m_object_database.MoveObjectToBack(child);
             }
 
             /* If we read fewer than the batch size, we're done. */
@@ -212,12 +247,29 @@ namespace haze {
         /* Flush the data response. */
         R_TRY(db.Commit());
 
+        /* Forget children that are no longer on the filesystem, along with everything below them. */
+        PtpObject *next;
+        for (PtpObject *child = m_object_database.GetFirstChild(obj->GetObjectId()); child != nullptr; child = next) {
+            next = child->GetNextSibling();
+
+            if (child->GetIsListed()) {
+                child->SetIsListed(false);
+            } else {
+                m_object_database.DeleteObjectTree(child);
+            }
+        }
+
+        /* Remember the listing, unless the directory changed while we were reading it. */
+        if (listed_count == entry_count) {
+            m_directory_cache.Store(obj);
+        }
+
         /* Write the success response. */
         R_RETURN(this->WriteResponse(PtpResponseCode_Ok));
     }
 
     Result PtpResponder::GetObjectInfo(PtpDataParser &dp) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         /* Get the object ID the client requested info for. */
         u32 object_id;
@@ -241,23 +293,12 @@ namespace haze {
             object_info.association_type = PtpAssociationType_GenericFolder;
             object_info.filename         = it->impl->GetDisplayName();
         } else {
-            /* Figure out what type of object this is. */
+            /* Figure out what type of object this is, and its size. */
             FsDirEntryType entry_type;
-            R_TRY(Fs(obj).GetEntryType(obj->GetName(), std::addressof(entry_type)));
-
-            /* Get the size, if we are requesting info about a file. */
-            s64 size = 0;
-            if (entry_type == FsDirEntryType_File) {
-                FsFile file;
-                R_TRY(Fs(obj).OpenFile(obj->GetName(), FsOpenMode_Read, std::addressof(file)));
-
-                /* Ensure we maintain a clean state on exit. */
-                ON_SCOPE_EXIT { Fs(obj).CloseFile(std::addressof(file)); };
-
-                R_TRY(Fs(obj).GetFileSize(std::addressof(file), std::addressof(size)));
-            }
+            s64 size;
+            R_TRY(this->GetObjectEntryInfo(obj, std::addressof(entry_type), std::addressof(size)));
 
-            object_info.filename               = std::strrchr(obj->GetName(), '/') + 1;
+            object_info.filename               = obj->GetBaseName();
             object_info.object_compressed_size = size;
             object_info.parent_object          = obj->GetParentId();
 
@@ -300,7 +341,7 @@ namespace haze {
     }
 
     Result PtpResponder::GetObject(PtpDataParser &dp) {
-        PtpDataBuilder db(m_buffers->usb_bulk_write_buffer, std::addressof(m_usb_server));
+        PtpDataBuilder db(m_transport);
 
         /* Get the object ID the client requested. */
         u32 object_id;
@@ -312,41 +353,89 @@ namespace haze {
         R_UNLESS(obj != nullptr, haze::ResultInvalidObjectId());
 
         /* Lock the object as a file. */
+        const char *path;
+        R_TRY(this->GetObjectPath(obj, std::addressof(path)));
+
+        /* The file may already be open, with its start read, if we guessed it would be asked for. */
         FsFile file;
-        R_TRY(Fs(obj).OpenFile(obj->GetName(), FsOpenMode_Read, std::addressof(file)));
+        s64 file_size = 0;
+        const u8 *prefetched_data = nullptr;
+        s64 prefetched_size = 0;
+        const bool prefetched = m_prefetcher.Take(object_id, std::addressof(file), std::addressof(file_size), std::addressof(prefetched_data), std::addressof(prefetched_size));
+
+        if (!prefetched) {
+            R_TRY(Fs(obj).OpenFile(path, FsOpenMode_Read, std::addressof(file)));
+        }
 
         /* Ensure we maintain a clean state on exit. */
         ON_SCOPE_EXIT { Fs(obj).CloseFile(std::addressof(file)); };
 
         /* Get the file's size. */
-        s64 file_size = 0;
-        R_TRY(Fs(obj).GetFileSize(std::addressof(file), std::addressof(file_size)));
+        if (!prefetched) {
+            R_TRY(Fs(obj).GetFileSize(std::addressof(file), std::addressof(file_size)));
+        }
+
+        /* Pick how to lay out the transfer. This must happen before any buffer is acquired. */
+        u32 candidate;
+        const TransferConfig config = m_transfer_tuner.Select(obj->GetStorageId(), TransferDirection_ToHost, file_size, std::addressof(candidate));
+        R_TRY(m_transport->SetWritePacketCount(config.packet_count));
 
         /* Send the header and file size. */
         R_TRY(db.AddDataHeader(m_request_header, file_size));
 
-        WriteCallbackFile(CallbackType_ReadBegin, obj->GetName());
-        ON_SCOPE_EXIT { WriteCallbackFile(CallbackType_ReadEnd, obj->GetName()); };
+        WriteCallbackFile(CallbackType_ReadBegin, path);
+        ON_SCOPE_EXIT { WriteCallbackFile(CallbackType_ReadEnd, path); };
 
         auto mode = sphaira::thread::Mode::MultiThreaded;
         if (!Fs(obj).MultiThreadTransfer(file_size, true)) {
             mode = sphaira::thread::Mode::SingleThreadedIfSmaller;
         }
 
-        R_TRY(sphaira::thread::Transfer(file_size,
-            [this, &file, &obj](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
+        /* File data is read straight into the transfer buffers, following the header. */
+        sphaira::thread::Stats stats;
+        R_TRY(sphaira::thread::TransferZeroCopy(file_size,
+            [&db](void** out_data, s64* out_size) -> Result {
+                /* Get the next buffer to fill. */
+                u8 *data;
+                u32 size;
+                R_TRY(db.AcquireBuffer(std::addressof(data), std::addressof(size)));
+
+                *out_data = data;
+                *out_size = size;
+                R_SUCCEED();
+            },
+            [this, &file, &obj, prefetched_data, prefetched_size](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
+                /* The start of the file may already have been read. */
+                if (off < prefetched_size) {
+                    const s64 copy_size = std::min(size, prefetched_size - off);
+                    std::memcpy(data, prefetched_data + off, copy_size);
+                    *bytes_read = copy_size;
+                    R_SUCCEED();
+                }
+
                 /* Get the next batch. */
                 R_TRY(Fs(obj).ReadFile(std::addressof(file), off, data, size, FsReadOption_None, bytes_read));
                 R_SUCCEED();
             },
-            [this, &db](const void* data, s64 off, s64 size) -> Result {
+            [this, &db](void* data, s64 off, s64 size) -> Result {
                 /* Write to output. */
-                R_TRY(db.AddBuffer((const u8*)data, size));
+                R_TRY(db.PostBuffer(static_cast<u8 *>(data), size));
                 WriteCallbackProgress(CallbackType_ReadProgress, off, size);
                 R_SUCCEED();
-            }, mode
+            },
+            [&db](void* data) {
+                db.ReleaseBuffer(static_cast<u8 *>(data));
+            }, mode, config.depth, std::addressof(stats), m_reactor, Fs(obj).GetReadThreadCount(file_size)
         ));
 
+        /* The header promised the whole file, so sending less of it is a failure. */
+        R_UNLESS(stats.size == file_size, haze::ResultTransferFailed());
+
+        m_transfer_tuner.Report(obj->GetStorageId(), TransferDirection_ToHost, candidate, stats);
+
+        /* Start on the next file while the host handles this one. */
+        this->PrefetchNextObject(obj);
+
         /* Flush the data response. */
         R_TRY(db.Commit());
 
@@ -364,7 +453,7 @@ namespace haze {
         R_TRY(rdp.Read(std::addressof(parent_object)));
         R_TRY(rdp.Finalize());
 
-        PtpDataParser dp(m_buffers->usb_bulk_read_buffer, std::addressof(m_usb_server));
+        PtpDataParser dp(m_transport);
         PtpObjectInfo info(DefaultObjectInfo);
 
         /* Ensure we have a data header. */
@@ -412,23 +501,28 @@ namespace haze {
 
         /* Create the object in the database. */
         PtpObject *obj;
-        R_TRY(m_object_database.CreateOrFindObject(parentobj->GetName(), m_buffers->filename_string_buffer, parentobj->GetObjectId(), parentobj->GetStorageId(), std::addressof(obj)));
+        R_TRY(m_object_database.CreateOrFindObject(m_buffers->filename_string_buffer, parentobj->GetObjectId(), parentobj->GetStorageId(), std::addressof(obj)));
 
         /* Ensure we maintain a clean state on failure. */
         ON_RESULT_FAILURE { m_object_database.DeleteObject(obj); };
 
         /* Register the object with a new ID. */
-        m_object_database.RegisterObject(obj);
+        R_TRY(m_object_database.RegisterObject(obj));
         new_object_info.object_id = obj->GetObjectId();
 
+        const char *path;
+        R_TRY(this->GetObjectPath(obj, std::addressof(path)));
+
         /* Create the object on the filesystem. */
         if (info.object_format == PtpObjectFormatCode_Association) {
-            R_TRY(Fs(obj).CreateDirectory(obj->GetName()));
-            WriteCallbackFile(CallbackType_CreateFolder, obj->GetName());
+            R_TRY(Fs(obj).CreateDirectory(path));
+            obj->SetCachedInfo(FsDirEntryType_Dir, 0);
+            WriteCallbackFile(CallbackType_CreateFolder, path);
             m_send_object_id = 0;
         } else {
-            R_TRY(Fs(obj).CreateFile(obj->GetName(), 0, 0));
-            WriteCallbackFile(CallbackType_CreateFile, obj->GetName());
+            R_TRY(Fs(obj).CreateFile(path, 0, 0));
+            obj->SetCachedInfo(FsDirEntryType_File, 0);
+            WriteCallbackFile(CallbackType_CreateFile, path);
             m_send_object_id = new_object_info.object_id;
         }
 
@@ -442,7 +536,7 @@ namespace haze {
 
         R_TRY(rdp.Finalize());
 
-        PtpDataParser dp(m_buffers->usb_bulk_read_buffer, std::addressof(m_usb_server));
+        PtpDataParser dp(m_transport);
 
         /* Ensure we have a data header. */
         PtpUsbBulkContainer data_header;
@@ -456,8 +550,11 @@ namespace haze {
         R_UNLESS(obj != nullptr, haze::ResultInvalidObjectId());
 
         /* Lock the object as a file. */
+        const char *path;
+        R_TRY(this->GetObjectPath(obj, std::addressof(path)));
+
         FsFile file;
-        R_TRY(Fs(obj).OpenFile(obj->GetName(), FsOpenMode_Write | FsOpenMode_Append, std::addressof(file)));
+        R_TRY(Fs(obj).OpenFile(path, FsOpenMode_Write | FsOpenMode_Append, std::addressof(file)));
 
         /* Ensure we maintain a clean state on exit. */
         ON_SCOPE_EXIT { Fs(obj).CloseFile(std::addressof(file)); };
@@ -465,11 +562,14 @@ namespace haze {
         /* Dummy file size for the threaded transfer. */
         auto file_size = 4_GB;
         u64 offset = 0;
+        bool size_known = true;
+        bool complete = false;
 
         if (m_send_prop_list) {
             file_size = m_send_prop_list->size;
         } else {
-            if (data_header.length > sizeof(PtpUsbBulkContainer)) {
+            size_known = data_header.length > sizeof(PtpUsbBulkContainer);
+            if (size_known) {
                 /* Got the real file size. */
                 file_size = data_header.length - sizeof(PtpUsbBulkContainer);
                 R_TRY(Fs(obj).SetFileSize(std::addressof(file), file_size));
@@ -481,49 +581,70 @@ namespace haze {
 
         /* Truncate the file to the received size. */
         ON_SCOPE_EXIT{
+            obj->SetCachedInfo(FsDirEntryType_File, offset);
+
             if (offset != file_size) {
-                Fs(obj).SetFileSize(std::addressof(file), offset);
+                if (R_FAILED(Fs(obj).SetFileSize(std::addressof(file), offset))) {
+                    obj->InvalidateCachedInfo();
+                }
+
+                /* The host still thinks the file has the size it announced, or the size it had before a failed upload. */
+                /* Otherwise, the dummy size was never announced, and the host learns the real one when it asks. */
+                if (size_known || !complete) {
+                    m_event_queue->Push(NotifyType_Changed, obj->GetObjectId());
+                }
             }
         };
 
-        WriteCallbackFile(CallbackType_WriteBegin, obj->GetName());
-        ON_SCOPE_EXIT { WriteCallbackFile(CallbackType_WriteEnd, obj->GetName()); };
+        WriteCallbackFile(CallbackType_WriteBegin, path);
+        ON_SCOPE_EXIT { WriteCallbackFile(CallbackType_WriteEnd, path); };
 
         auto mode = sphaira::thread::Mode::MultiThreaded;
         if (!Fs(obj).MultiThreadTransfer(0, false)) {
             mode = sphaira::thread::Mode::SingleThreaded;
         }
 
-        bool is_done = false;
+        /* Pick how deep to queue the transfer. */
+        u32 candidate;
+        const TransferConfig config = m_transfer_tuner.Select(obj->GetStorageId(), TransferDirection_FromHost, file_size, std::addressof(candidate));
 
-        R_TRY(sphaira::thread::Transfer(file_size,
-            [this, &dp, &is_done](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
-                if (is_done) {
-                    *bytes_read = 0;
-                    R_SUCCEED();
-                }
+        /* The file is already its full size when the size is known, so packets may be written out of order. */
+        const u32 writers = size_known ? Fs(obj).GetWriteThreadCount(file_size) : 1;
 
-                /* Read as many bytes as we can. */
-                u32 bytes_received;
-                const Result read_res = dp.ReadBuffer((u8*)data, size, std::addressof(bytes_received));
-                *bytes_read = bytes_received;
+        /* Packets follow the container header, so the filesystem may want them gathered into aligned writes. */
+        const u32 align = Fs(obj).GetWriteAlignment(file_size);
 
-                /* If we received fewer bytes than the batch size, we're done. */
-                if (haze::ResultEndOfTransmission::Includes(read_res)) {
-                    is_done = true;
-                    R_SUCCEED();
-                }
+        /* Received packets are written to the file as they are, following the header. */
+        sphaira::thread::Stats stats;
+        const auto rc = sphaira::thread::TransferBuffers(file_size,
+            [&dp](void** out_data, s64* out_size) -> Result {
+                /* Take the next received data, which is empty once the transmission ends. */
+                u8 *data;
+                u32 size;
+                R_TRY(dp.AcquireBuffer(std::addressof(data), std::addressof(size)));
 
-                R_RETURN(read_res);
+                *out_data = data;
+                *out_size = size;
+                R_SUCCEED();
             },
-            [this, &file, &obj, &offset](const void* data, s64 off, s64 size) -> Result {
+            [this, &file, &obj](const void* data, s64 off, s64 size) -> Result {
                 /* Write to the file. */
                 R_TRY(Fs(obj).WriteFile(std::addressof(file), off, data, size, 0));
                 WriteCallbackProgress(CallbackType_WriteProgress, off, size);
-                offset += size;
                 R_SUCCEED();
-            }, mode
-        ));
+            },
+            [&dp](void* data) {
+                dp.ReleaseBuffer(static_cast<const u8 *>(data));
+            }, mode, config.depth, std::addressof(stats), m_reactor, writers, align
+        );
+
+        /* Only keep what was written with no gaps before it. */
+        offset = stats.size;
+        R_TRY(rc);
+
+        complete = true;
+
+        m_transfer_tuner.Report(obj->GetStorageId(), TransferDirection_FromHost, candidate, stats);
 
         /* Write the success response. */
         R_RETURN(this->WriteResponse(PtpResponseCode_Ok));
@@ -545,21 +666,24 @@ namespace haze {
         auto * const obj = m_object_database.GetObjectById(object_id);
         R_UNLESS(obj != nullptr, haze::ResultInvalidObjectId());
 
+        const char *path;
+        R_TRY(this->GetObjectPath(obj, std::addressof(path)));
+
         /* Figure out what type of object this is. */
         FsDirEntryType entry_type;
-        R_TRY(Fs(obj).GetEntryType(obj->GetName(), std::addressof(entry_type)));
+        R_TRY(Fs(obj).GetEntryType(path, std::addressof(entry_type)));
 
         /* Remove the object from the filesystem. */
         if (entry_type == FsDirEntryType_Dir) {
-            WriteCallbackFile(CallbackType_DeleteFolder, obj->GetName());
-            R_TRY(Fs(obj).DeleteDirectoryRecursively(obj->GetName()));
+            WriteCallbackFile(CallbackType_DeleteFolder, path);
+            R_TRY(Fs(obj).DeleteDirectoryRecursively(path));
         } else {
-            WriteCallbackFile(CallbackType_DeleteFile, obj->GetName());
-            R_TRY(Fs(obj).DeleteFile(obj->GetName()));
+            WriteCallbackFile(CallbackType_DeleteFile, path);
+            R_TRY(Fs(obj).DeleteFile(path));
         }
 
         /* Remove the object from the database. */
-        m_object_database.DeleteObject(obj);
+        m_object_database.DeleteObjectTree(obj);
 
         /* Write the success response. */
         R_RETURN(this->WriteResponse(PtpResponseCode_Ok));
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/ptp_string.hpp>
+
+#include <vapours/util/util_character_encoding.hpp>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace haze {
+
+    namespace {
+
+        /* Strings are mostly ASCII, which is converted a block at a time. */
+        constexpr size_t BlockLength = 16;
+
+        constexpr char ReplacementCharacter = '?';
+
+        ALWAYS_INLINE bool WidenAsciiBlock(u16 *dst, const char *src) {
+            #if defined(__ARM_NEON)
+                const uint8x16_t chars = vld1q_u8(reinterpret_cast<const u8 *>(src));
+
+                if (vmaxvq_u8(chars) >= 0x80) {
+                    return false;
+                }
+
+                vst1q_u16(dst + 0, vmovl_u8(vget_low_u8(chars)));
+                vst1q_u16(dst + 8, vmovl_high_u8(chars));
+            #elif defined(__SSE2__)
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+
+                if (_mm_movemask_epi8(chars) != 0) {
+                    return false;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 0), _mm_unpacklo_epi8(chars, _mm_setzero_si128()));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 8), _mm_unpackhi_epi8(chars, _mm_setzero_si128()));
+            #else
+                u64 words[BlockLength / sizeof(u64)];
+                std::memcpy(words, src, sizeof(words));
+
+                if (((words[0] | words[1]) & 0x8080808080808080ULL) != 0) {
+                    return false;
+                }
+
+                for (size_t i = 0; i < BlockLength; i++) {
+                    dst[i] = static_cast<u8>(src[i]);
+                }
+            #endif
+
+            return true;
+        }
+
+        ALWAYS_INLINE bool NarrowAsciiBlock(char *dst, const u16 *src) {
+            #if defined(__ARM_NEON)
+                const uint16x8_t lo = vld1q_u16(src + 0);
+                const uint16x8_t hi = vld1q_u16(src + 8);
+
+                if (vmaxvq_u16(vorrq_u16(lo, hi)) >= 0x80) {
+                    return false;
+                }
+
+                vst1q_u8(reinterpret_cast<u8 *>(dst), vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+            #elif defined(__SSE2__)
+                const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 0));
+                const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 8));
+
+                const __m128i high_bits = _mm_and_si128(_mm_or_si128(lo, hi), _mm_set1_epi16(static_cast<s16>(0xFF80)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, _mm_setzero_si128())) != 0xFFFF) {
+                    return false;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(lo, hi));
+            #else
+                u16 high_bits = 0;
+                for (size_t i = 0; i < BlockLength; i++) {
+                    high_bits |= src[i];
+                }
+
+                if ((high_bits & 0xFF80) != 0) {
+                    return false;
+                }
+
+                for (size_t i = 0; i < BlockLength; i++) {
+                    dst[i] = static_cast<char>(src[i]);
+                }
+            #endif
+
+            return true;
+        }
+
+        constexpr size_t GetUtf16Length(u32 code_point) {
+            return code_point >= 0x10000 ? 2 : 1;
+        }
+
+        constexpr size_t GetUtf8Length(u32 code_point) {
+            if (code_point < 0x80) {
+                return 1;
+            } else if (code_point < 0x800) {
+                return 2;
+            } else if (code_point < 0x10000) {
+                return 3;
+            } else {
+                return 4;
+            }
+        }
+
+    }
+
+    size_t ConvertUtf8ToPtpString(u16 *dst, size_t max_length, const char *src) {
+        const char * const src_end = src + std::strlen(src);
+        size_t length = 0;
+
+        while (src < src_end) {
+            /* Convert ASCII a block at a time while there is room. */
+            if (src_end - src >= static_cast<ptrdiff_t>(BlockLength) && max_length - length >= BlockLength && WidenAsciiBlock(dst + length, src)) {
+                src    += BlockLength;
+                length += BlockLength;
+                continue;
+            }
+
+            /* Otherwise, convert a single character. */
+            u32 code_point;
+            size_t src_length;
+            if (util::ConvertCharacterUtf8ToUtf32(std::addressof(code_point), src) == util::CharacterEncodingResult_Success) {
+                src_length = util::impl::CharacterEncodingHelper::GetUtf8NBytes(static_cast<unsigned char>(*src));
+            } else {
+                code_point = ReplacementCharacter;
+                src_length = 1;
+            }
+
+            if (max_length - length < GetUtf16Length(code_point)) {
+                break;
+            }
+
+            if (code_point >= 0x10000) {
+                dst[length++] = static_cast<u16>(0xD800 + ((code_point - 0x10000) >> 10));
+                dst[length++] = static_cast<u16>(0xDC00 + ((code_point - 0x10000) & 0x3FF));
+            } else {
+                dst[length++] = static_cast<u16>(code_point);
+            }
+
+            src += src_length;
+        }
+
+        return length;
+    }
+
+    void ConvertPtpStringToUtf8(char *dst, size_t dst_size, const u16 *src, size_t length) {
+        HAZE_ASSERT(dst_size > 0);
+
+        /* Leave room for the null terminator. */
+        const size_t max_size = dst_size - 1;
+        size_t size = 0;
+
+        for (size_t i = 0; i < length; ) {
+            /* Convert ASCII a block at a time while there is room. */
+            if (length - i >= BlockLength && max_size - size >= BlockLength && NarrowAsciiBlock(dst + size, src + i)) {
+                i    += BlockLength;
+                size += BlockLength;
+                continue;
+            }
+
+            /* Otherwise, convert a single character, combining surrogate pairs. */
+            u32 code_point = src[i];
+            size_t src_length = 1;
+            if (code_point >= 0xD800 && code_point < 0xE000) {
+                if (code_point < 0xDC00 && i + 1 < length && src[i + 1] >= 0xDC00 && src[i + 1] < 0xE000) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (src[i + 1] - 0xDC00);
+                    src_length = 2;
+                } else {
+                    code_point = ReplacementCharacter;
+                }
+            }
+
+            const size_t dst_length = GetUtf8Length(code_point);
+            if (max_size - size < dst_length) {
+                break;
+            }
+
+            switch (dst_length) {
+                case 1:
+                    dst[size++] = static_cast<char>(code_point);
+                    break;
+                case 2:
+                    dst[size++] = static_cast<char>(0xC0 | (code_point >> 6));
+                    dst[size++] = static_cast<char>(0x80 | (code_point & 0x3F));
+                    break;
+                case 3:
+                    dst[size++] = static_cast<char>(0xE0 | (code_point >> 12));
+                    dst[size++] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                    dst[size++] = static_cast<char>(0x80 | (code_point & 0x3F));
+                    break;
+                case 4:
+                    dst[size++] = static_cast<char>(0xF0 | (code_point >> 18));
+                    dst[size++] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+                    dst[size++] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+                    dst[size++] = static_cast<char>(0x80 | (code_point & 0x3F));
+                    break;
+            }
+
+            i += src_length;
+        }
+
+        dst[size] = '\x00';
+    }
+
+}
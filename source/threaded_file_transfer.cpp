@@ -1,70 +1,195 @@
 #include "haze/threaded_file_transfer.hpp"
 #include "haze/thread.hpp"
+#include "haze/cancel_token.hpp"
+#include "haze/event_reactor.hpp"
+#include "haze/results.hpp"
 
 #include <vector>
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <atomic>
+#include <utility>
 
 namespace sphaira::thread {
 namespace {
 
 constexpr u64 BUFFER_SIZE = 1024*1024*1;
 
-struct ThreadBuffer {
-    ThreadBuffer() {
-        buf.reserve(BUFFER_SIZE);
+// how often threads are woken while waiting for them to exit.
+constexpr u64 EXIT_WAKE_INTERVAL_NS = 1000000;
+
+haze::CancelToken* GetCancelToken(haze::EventReactor* reactor) {
+    return reactor ? reactor->GetCancelToken() : nullptr;
+}
+
+Result CheckCancel(haze::CancelToken* cancel) {
+    if (cancel) {
+        return cancel->GetResult();
     }
+    R_SUCCEED();
+}
+
+// how long a thread spins on a ring before sleeping until the other side wakes it.
+constexpr u64 HANDOFF_SPIN_NS = 20000;
+
+// rings are padded so that each side's index has a cache line to itself.
+constexpr std::size_t CACHE_LINE_SIZE = 64;
 
+void CpuRelax() {
+#if defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+struct ThreadBuffer {
     std::vector<u8> buf;
     s64 off;
 };
 
-template<std::size_t Size>
-struct RingBuf {
-private:
-    ThreadBuffer buf[Size]{};
-    unsigned r_index{};
-    unsigned w_index{};
+// buffers that uploaded data is gathered into for aligned writes.
+// they're left uninitialised, as every byte is copied in before it's written.
+struct AlignedBuffers {
+    void* bufs[MAX_DEPTH];
+    unsigned count;
+    s64 size;
+
+    // makes sure there are count buffers of at least size, reusing those already allocated.
+    Result Reserve(unsigned new_count, s64 new_size) {
+        if (size < new_size) {
+            Free();
+            size = new_size;
+        }
 
-    static_assert((sizeof(RingBuf::buf) & (sizeof(RingBuf::buf) - 1)) == 0, "Must be power of 2!");
+        while (count < new_count) {
+            bufs[count] = std::malloc(size);
+            R_UNLESS(bufs[count] != nullptr, haze::ResultOutOfMemory());
+            count++;
+        }
 
-public:
-    void ringbuf_reset() {
-        this->r_index = this->w_index;
+        R_SUCCEED();
     }
 
+    void Free() {
+        for (unsigned i = 0; i < count; i++) {
+            std::free(bufs[i]);
+        }
+
+        count = 0;
+        size = 0;
+    }
+};
+
+// number of aligned buffers a transfer may use, keeping within MAX_WRITE_ALIGN_MEMORY.
+unsigned GetAlignedDepth(unsigned depth, s64 align) {
+    return std::clamp<unsigned>(MAX_WRITE_ALIGN_MEMORY / align, 1U, std::clamp(depth, 1U, MAX_DEPTH));
+}
+
+// lock-free ring with one producer and one consumer thread, each of which only writes its own index.
+// the producer fills ringbuf_back() before ringbuf_push(), the consumer empties ringbuf_front() before ringbuf_pop().
+template<typename T, std::size_t Size>
+struct SpscRing {
+private:
+    static_assert((Size & (Size - 1)) == 0, "Must be power of 2!");
+
+    alignas(CACHE_LINE_SIZE) T buf[Size]{};
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned> w_index{};
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned> r_index{};
+
+public:
     unsigned ringbuf_capacity() const {
-        return sizeof(this->buf) / sizeof(this->buf[0]);
+        return Size;
     }
 
     unsigned ringbuf_size() const {
-        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
+        return this->w_index.load(std::memory_order_acquire) - this->r_index.load(std::memory_order_acquire);
     }
 
     unsigned ringbuf_free() const {
         return ringbuf_capacity() - ringbuf_size();
     }
 
-    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
-        auto& value = this->buf[this->w_index % ringbuf_capacity()];
-        value.off = off_in;
-        std::swap(value.buf, buf_in);
+    // producer only, the ring must not be full.
+    T& ringbuf_back() {
+        return this->buf[this->w_index.load(std::memory_order_relaxed) % Size];
+    }
+
+    void ringbuf_push() {
+        this->w_index.store(this->w_index.load(std::memory_order_relaxed) + 1U, std::memory_order_release);
+    }
+
+    void ringbuf_push(const T& buf_in) {
+        ringbuf_back() = buf_in;
+        ringbuf_push();
+    }
+
+    // consumer only, the ring must not be empty.
+    T& ringbuf_front() {
+        return this->buf[this->r_index.load(std::memory_order_relaxed) % Size];
+    }
+
+    void ringbuf_pop() {
+        this->r_index.store(this->r_index.load(std::memory_order_relaxed) + 1U, std::memory_order_release);
+    }
+
+    void ringbuf_pop(T& buf_out) {
+        buf_out = ringbuf_front();
+        ringbuf_pop();
+    }
+};
+
+// wakes a thread waiting on a ring. the waiter spins for a while before sleeping, and the other side
+// only takes the lock if it is asleep, so neither touches the kernel while the ring keeps moving.
+struct Handoff {
+    Handoff() {
+        mutexInit(std::addressof(mutex));
+        condvarInit(std::addressof(cond));
+    }
+
+    // returns once ready() is true, or once woken.
+    template<typename F>
+    void Wait(F&& ready) {
+        const auto spin_ticks = armNsToTicks(HANDOFF_SPIN_NS);
+        const auto tick = armGetSystemTick();
+        while (armGetSystemTick() - tick < spin_ticks) {
+            if (ready()) {
+                return;
+            }
+            CpuRelax();
+        }
+
+        mutexLock(std::addressof(mutex));
+        ON_SCOPE_EXIT { mutexUnlock(std::addressof(mutex)); };
 
-        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
+        // either Notify() sees that we're waiting, or we see what it was notifying about.
+        waiting = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready()) {
+            condvarWait(std::addressof(cond), std::addressof(mutex));
+        }
+        waiting = false;
     }
 
-    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
-        auto& value = this->buf[this->r_index % ringbuf_capacity()];
-        off_out = value.off;
-        std::swap(value.buf, buf_out);
+    void Notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting) {
+            mutexLock(std::addressof(mutex));
+            ON_SCOPE_EXIT { mutexUnlock(std::addressof(mutex)); };
 
-        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
+            condvarWakeAll(std::addressof(cond));
+        }
     }
+
+private:
+    Mutex mutex{};
+    CondVar cond{};
+    std::atomic_bool waiting{};
 };
 
 struct ThreadData {
-    ThreadData(UEvent& _uevent, s64 size, const ReadCallback& _rfunc, const WriteCallback& _wfunc, u64 buffer_size);
+    ThreadData(UEvent& _uevent, s64 size, const ReadCallback& _rfunc, const WriteCallback& _wfunc, u64 buffer_size, unsigned depth);
 
     auto GetResults() volatile -> Result;
     void WakeAllThreads();
@@ -89,8 +214,16 @@ struct ThreadData {
         return write_size;
     }
 
-    Result readFuncInternal();
-    Result writeFuncInternal();
+    unsigned GetReaderCount() const {
+        return 1;
+    }
+
+    unsigned GetWriterCount() const {
+        return 1;
+    }
+
+    Result readFuncInternal(unsigned index);
+    Result writeFuncInternal(unsigned index);
 
 private:
     Result SetWriteBuf(std::vector<u8>& buf, s64 size);
@@ -105,14 +238,13 @@ private:
     const WriteCallback& wfunc;
 
     // these need to be created
-    Mutex mutex{};
-
-    CondVar can_read{};
-    CondVar can_write{};
+    Handoff can_read{};
+    Handoff can_write{};
 
-    RingBuf<2> write_buffers{};
+    SpscRing<ThreadBuffer, MAX_DEPTH> write_buffers{};
 
     const u64 read_buffer_size;
+    const unsigned max_queued;
     const s64 write_size;
 
     // these are shared between threads
@@ -124,18 +256,19 @@ private:
 
     std::atomic_bool read_running{true};
     std::atomic_bool write_running{true};
+
+    // each only touched by its own thread.
+    u64 read_stall_ticks{};
+    u64 write_stall_ticks{};
 };
 
-ThreadData::ThreadData(UEvent& _uevent, s64 size, const ReadCallback& _rfunc, const WriteCallback& _wfunc, u64 buffer_size)
+ThreadData::ThreadData(UEvent& _uevent, s64 size, const ReadCallback& _rfunc, const WriteCallback& _wfunc, u64 buffer_size, unsigned depth)
 : uevent{_uevent}
 , rfunc{_rfunc}
 , wfunc{_wfunc}
 , read_buffer_size{buffer_size}
+, max_queued{std::clamp(depth, 1U, MAX_DEPTH)}
 , write_size{size} {
-    mutexInit(std::addressof(mutex));
-
-    condvarInit(std::addressof(can_read));
-    condvarInit(std::addressof(can_write));
 }
 
 auto ThreadData::GetResults() volatile -> Result {
@@ -145,44 +278,60 @@ auto ThreadData::GetResults() volatile -> Result {
 }
 
 void ThreadData::WakeAllThreads() {
-    condvarWakeAll(std::addressof(can_read));
-    condvarWakeAll(std::addressof(can_write));
-
-    mutexUnlock(std::addressof(mutex));
+    can_read.Notify();
+    can_write.Notify();
 }
 
 Result ThreadData::SetWriteBuf(std::vector<u8>& buf, s64 size) {
     buf.resize(size);
 
-    mutexLock(std::addressof(mutex));
-    if (!write_buffers.ringbuf_free()) {
+    while (write_buffers.ringbuf_size() >= max_queued) {
         if (!write_running) {
             R_SUCCEED();
         }
 
-        R_TRY(condvarWait(std::addressof(can_read), std::addressof(mutex)));
+        R_TRY(GetResults());
+
+        const auto tick = armGetSystemTick();
+        can_read.Wait([this] { return write_buffers.ringbuf_size() < max_queued || !write_running || R_FAILED(GetResults()); });
+        read_stall_ticks += armGetSystemTick() - tick;
     }
 
-    ON_SCOPE_EXIT { mutexUnlock(std::addressof(mutex)); };
     R_TRY(GetResults());
-    write_buffers.ringbuf_push(buf, 0);
-    return condvarWakeOne(std::addressof(can_write));
+
+    auto& value = write_buffers.ringbuf_back();
+    value.off = 0;
+    std::swap(value.buf, buf);
+    write_buffers.ringbuf_push();
+
+    can_write.Notify();
+    R_SUCCEED();
 }
 
 Result ThreadData::GetWriteBuf(std::vector<u8>& buf_out, s64& off_out) {
-    mutexLock(std::addressof(mutex));
-    if (!write_buffers.ringbuf_size()) {
-        if (!read_running) {
+    while (!write_buffers.ringbuf_size()) {
+        // the reader may push its last buffer just before it stops, so only give up once the ring is still empty.
+        if (!read_running && !write_buffers.ringbuf_size()) {
             buf_out.resize(0);
             R_SUCCEED();
         }
-        R_TRY(condvarWait(std::addressof(can_write), std::addressof(mutex)));
+
+        R_TRY(GetResults());
+
+        const auto tick = armGetSystemTick();
+        can_write.Wait([this] { return write_buffers.ringbuf_size() || !read_running || R_FAILED(GetResults()); });
+        write_stall_ticks += armGetSystemTick() - tick;
     }
 
-    ON_SCOPE_EXIT { mutexUnlock(std::addressof(mutex)); };
     R_TRY(GetResults());
-    write_buffers.ringbuf_pop(buf_out, off_out);
-    return condvarWakeOne(std::addressof(can_read));
+
+    auto& value = write_buffers.ringbuf_front();
+    off_out = value.off;
+    std::swap(value.buf, buf_out);
+    write_buffers.ringbuf_pop();
+
+    can_read.Notify();
+    R_SUCCEED();
 }
 
 Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
@@ -193,8 +342,12 @@ Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
 }
 
 // read thread reads all data from rfunc.
-Result ThreadData::readFuncInternal() {
-    ON_SCOPE_EXIT{ read_running = false; };
+Result ThreadData::readFuncInternal(unsigned) {
+    // the writer may be waiting on a buffer that will never come.
+    ON_SCOPE_EXIT {
+        read_running = false;
+        WakeAllThreads();
+    };
 
     // the main buffer which data is read into.
     std::vector<u8> buf;
@@ -219,7 +372,7 @@ Result ThreadData::readFuncInternal() {
 }
 
 // write thread writes data to wfunc.
-Result ThreadData::writeFuncInternal() {
+Result ThreadData::writeFuncInternal(unsigned) {
     ON_SCOPE_EXIT{ write_running = false; };
 
     std::vector<u8> buf;
@@ -240,88 +393,1184 @@ Result ThreadData::writeFuncInternal() {
     R_SUCCEED();
 }
 
-void readFunc(void* d) {
-    auto t = static_cast<ThreadData*>(d);
-    t->SetReadResult(t->readFuncInternal());
+struct ZeroCopyBuffer {
+    void* data;
+    s64 off;
+    s64 size;
+    // set when the buffer could not be filled, or written, which ends the transfer.
+    bool last;
+};
+
+// one of the threads filling buffers for a zero-copy transfer, with its own rings to the writer.
+struct ZeroCopyReader {
+    Handoff can_read{};
+
+    // there are never more buffers outstanding than either ring holds.
+    SpscRing<ZeroCopyBuffer, MAX_DEPTH> empty_buffers{};
+    SpscRing<ZeroCopyBuffer, MAX_DEPTH> full_buffers{};
+
+    // owned by the read thread while it is being filled.
+    ZeroCopyBuffer read_buffer{};
+
+    std::atomic_bool running{true};
+
+    // only touched by the read thread.
+    u64 stall_ticks{};
+};
+
+// the writer hands empty buffers to the readers, which hand them back filled.
+// buffers are dealt to the readers in turn and collected in the same order, so they are written in order.
+// only the writer acquires and consumes buffers, so they never cross to a third thread.
+struct ZeroCopyThreadData {
+    ZeroCopyThreadData(UEvent& _uevent, s64 size, const AcquireCallback& _afunc, const ReadCallback& _rfunc, const ConsumeCallback& _wfunc, unsigned depth, unsigned readers, haze::CancelToken* _cancel);
+
+    auto GetResults() volatile -> Result;
+    void WakeAllThreads();
+
+    // readers can't fill more buffers at once than are outstanding.
+    unsigned GetReaderCount() const {
+        return reader_count;
+    }
+
+    unsigned GetWriterCount() const {
+        return 1;
+    }
+
+    // keeps the first failure of any reader.
+    void SetReadResult(Result result) {
+        if (R_FAILED(result)) {
+            Result expected{Result::SuccessValue};
+            read_result.compare_exchange_strong(expected, result);
+            ueventSignal(&uevent);
+        }
+    }
+
+    void SetWriteResult(Result result) {
+        write_result = result;
+        ueventSignal(&uevent);
+    }
+
+    // returns every buffer which was acquired but never consumed, threads must have exited.
+    void ReleaseBuffers(const ReleaseCallback& ffunc);
+
+    // threads must have exited.
+    void GetStats(Stats* out) const {
+        u64 read_stall_ticks{};
+        for (unsigned i = 0; i < reader_count; i++) {
+            read_stall_ticks += readers[i].stall_ticks;
+        }
+
+        out->size = write_offset;
+        out->read_stall_ns = armTicksToNs(read_stall_ticks / reader_count);
+        out->write_stall_ns = armTicksToNs(write_stall_ticks);
+    }
+
+    Result readFuncInternal(unsigned index);
+    Result writeFuncInternal(unsigned index);
+
+private:
+    Result GetEmptyBuf(ZeroCopyReader& reader, ZeroCopyBuffer& buf_out);
+    Result SetFullBuf(ZeroCopyReader& reader, const ZeroCopyBuffer& buf);
+    Result SetEmptyBuf(const ZeroCopyBuffer& buf);
+    Result GetFullBuf(ZeroCopyBuffer& buf_out);
+
+private:
+    // these need to be copied
+    UEvent& uevent;
+    const AcquireCallback& afunc;
+    const ReadCallback& rfunc;
+    const ConsumeCallback& wfunc;
+    haze::CancelToken* const cancel;
+
+    // these need to be created
+    Handoff can_write{};
+
+    ZeroCopyReader readers[MAX_READERS]{};
+
+    // buffers acquired but not yet consumed, split between filling and waiting to be written.
+    const unsigned max_outstanding;
+    const unsigned reader_count;
+    const s64 write_size;
+
+    // only used by the write thread.
+    s64 acquire_offset{};
+    unsigned outstanding{};
+    unsigned acquire_count{};
+    unsigned consume_count{};
+
+    // these are shared between threads
+    std::atomic<s64> write_offset{};
+
+    // set once every buffer has been handed to a reader.
+    std::atomic_bool acquire_done{};
+
+    std::atomic<Result> read_result{Result::SuccessValue};
+    std::atomic<Result> write_result{Result::SuccessValue};
+
+    std::atomic_bool write_running{true};
+
+    // only touched by the write thread.
+    u64 write_stall_ticks{};
+};
+
+ZeroCopyThreadData::ZeroCopyThreadData(UEvent& _uevent, s64 size, const AcquireCallback& _afunc, const ReadCallback& _rfunc, const ConsumeCallback& _wfunc, unsigned depth, unsigned readers, haze::CancelToken* _cancel)
+: uevent{_uevent}
+, afunc{_afunc}
+, rfunc{_rfunc}
+, wfunc{_wfunc}
+, cancel{_cancel}
+, max_outstanding{std::clamp(depth, 1U, MAX_DEPTH)}
+, reader_count{std::clamp(readers, 1U, std::min(MAX_READERS, max_outstanding))}
+, write_size{size} {
 }
 
-void writeFunc(void* d) {
-    auto t = static_cast<ThreadData*>(d);
-    t->SetWriteResult(t->writeFuncInternal());
+auto ZeroCopyThreadData::GetResults() volatile -> Result {
+    R_TRY(read_result.load());
+    R_TRY(write_result.load());
+    R_TRY(CheckCancel(cancel));
+    R_SUCCEED();
 }
 
-Result TransferInternal(s64 size, const ReadCallback& rfunc, const WriteCallback& wfunc, Mode mode, u64 buffer_size = BUFFER_SIZE) {
-    if (mode == Mode::SingleThreadedIfSmaller) {
-        if ((u64)size <= buffer_size) {
-            mode = Mode::SingleThreaded;
-        } else {
-            mode = Mode::MultiThreaded;
+void ZeroCopyThreadData::WakeAllThreads() {
+    for (unsigned i = 0; i < reader_count; i++) {
+        readers[i].can_read.Notify();
+    }
+
+    can_write.Notify();
+}
+
+void ZeroCopyThreadData::ReleaseBuffers(const ReleaseCallback& ffunc) {
+    ZeroCopyBuffer buf;
+
+    for (unsigned i = 0; i < reader_count; i++) {
+        auto& reader = readers[i];
+
+        while (reader.empty_buffers.ringbuf_size()) {
+            reader.empty_buffers.ringbuf_pop(buf);
+            ffunc(buf.data);
+        }
+
+        while (reader.full_buffers.ringbuf_size()) {
+            reader.full_buffers.ringbuf_pop(buf);
+            ffunc(buf.data);
+        }
+
+        if (reader.read_buffer.data) {
+            ffunc(reader.read_buffer.data);
+            reader.read_buffer.data = nullptr;
         }
     }
+}
 
-    buffer_size = std::min<u64>(size, buffer_size);
+Result ZeroCopyThreadData::GetEmptyBuf(ZeroCopyReader& reader, ZeroCopyBuffer& buf_out) {
+    while (!reader.empty_buffers.ringbuf_size()) {
+        // the last buffer may have been handed to us just before we saw that there are no more.
+        if (!write_running || (acquire_done && !reader.empty_buffers.ringbuf_size())) {
+            buf_out = {};
+            R_SUCCEED();
+        }
 
-    if (mode == Mode::SingleThreaded) {
-        std::vector<u8> buf(buffer_size);
+        R_TRY(GetResults());
 
-        s64 offset{};
-        while (offset < size) {
-            u64 bytes_read;
-            const auto rsize = std::min<s64>(buf.size(), size - offset);
-            R_TRY(rfunc(buf.data(), offset, rsize, &bytes_read));
+        const auto tick = armGetSystemTick();
+        reader.can_read.Wait([&] { return reader.empty_buffers.ringbuf_size() || !write_running || acquire_done || R_FAILED(GetResults()); });
+        reader.stall_ticks += armGetSystemTick() - tick;
+    }
+
+    R_TRY(GetResults());
+    reader.empty_buffers.ringbuf_pop(buf_out);
+    R_SUCCEED();
+}
+
+Result ZeroCopyThreadData::SetFullBuf(ZeroCopyReader& reader, const ZeroCopyBuffer& buf) {
+    reader.full_buffers.ringbuf_push(buf);
+    can_write.Notify();
+    R_SUCCEED();
+}
+
+Result ZeroCopyThreadData::SetEmptyBuf(const ZeroCopyBuffer& buf) {
+    auto& reader = readers[acquire_count++ % reader_count];
+
+    reader.empty_buffers.ringbuf_push(buf);
+    reader.can_read.Notify();
+    R_SUCCEED();
+}
+
+Result ZeroCopyThreadData::GetFullBuf(ZeroCopyBuffer& buf_out) {
+    // buffers are collected in the order they were dealt.
+    auto& reader = readers[consume_count % reader_count];
+
+    while (!reader.full_buffers.ringbuf_size()) {
+        // recheck the ring, as in ThreadData::GetWriteBuf.
+        if (!reader.running && !reader.full_buffers.ringbuf_size()) {
+            buf_out = {};
+            R_SUCCEED();
+        }
+
+        R_TRY(GetResults());
+
+        const auto tick = armGetSystemTick();
+        can_write.Wait([&] { return reader.full_buffers.ringbuf_size() || !reader.running || R_FAILED(GetResults()); });
+        write_stall_ticks += armGetSystemTick() - tick;
+    }
+
+    R_TRY(GetResults());
+    reader.full_buffers.ringbuf_pop(buf_out);
+    consume_count++;
+    R_SUCCEED();
+}
+
+// each read thread fills its buffers in place from rfunc.
+Result ZeroCopyThreadData::readFuncInternal(unsigned index) {
+    auto& reader = this->readers[index];
+
+    // the writer may be waiting on a buffer that will never come.
+    ON_SCOPE_EXIT {
+        reader.running = false;
+        WakeAllThreads();
+    };
+
+    while (R_SUCCEEDED(this->GetResults())) {
+        R_TRY(this->GetEmptyBuf(reader, reader.read_buffer));
+        if (!reader.read_buffer.data) {
+            break;
+        }
+
+        // fill the whole buffer, so that the next one starts where it expects.
+        s64 filled{};
+        while (filled < reader.read_buffer.size) {
+            u64 bytes_read{};
+            R_TRY(this->rfunc((u8*)reader.read_buffer.data + filled, reader.read_buffer.off + filled, reader.read_buffer.size - filled, std::addressof(bytes_read)));
             if (!bytes_read) {
                 break;
             }
 
-            R_TRY(wfunc(buf.data(), offset, bytes_read));
-
-            offset += bytes_read;
+            filled += bytes_read;
         }
 
-        R_SUCCEED();
+        const auto short_read = filled < reader.read_buffer.size;
+        reader.read_buffer.size = filled;
+        reader.read_buffer.last = short_read;
+        R_TRY(this->SetFullBuf(reader, std::exchange(reader.read_buffer, {})));
+
+        if (short_read) {
+            break;
+        }
     }
-    else {
-        UEvent uevent;
-        ueventCreate(&uevent, false);
-        ThreadData t_data{uevent, size, rfunc, wfunc, buffer_size};
 
-        Thread t_read{};
-        R_TRY(utils::CreateThread(&t_read, readFunc, std::addressof(t_data)));
-        ON_SCOPE_EXIT { threadClose(&t_read); };
+    R_SUCCEED();
+}
 
-        Thread t_write{};
-        R_TRY(utils::CreateThread(&t_write, writeFunc, std::addressof(t_data)));
-        ON_SCOPE_EXIT { threadClose(&t_write); };
+// write thread acquires buffers for the readers and passes them to wfunc once filled.
+Result ZeroCopyThreadData::writeFuncInternal(unsigned) {
+    ON_SCOPE_EXIT{ write_running = false; };
 
-        R_TRY(threadStart(std::addressof(t_read)));
-        R_TRY(threadStart(std::addressof(t_write)));
+    while (this->write_offset < this->write_size && R_SUCCEEDED(this->GetResults())) {
+        // keep the readers supplied.
+        while (this->acquire_offset < this->write_size && this->outstanding < this->max_outstanding) {
+            ZeroCopyBuffer buf{};
+            R_TRY(this->afunc(std::addressof(buf.data), std::addressof(buf.size)));
 
-        ON_SCOPE_EXIT { threadWaitForExit(std::addressof(t_read)); };
-        ON_SCOPE_EXIT { threadWaitForExit(std::addressof(t_write)); };
+            buf.off = this->acquire_offset;
+            buf.size = std::min<s64>(buf.size, this->write_size - this->acquire_offset);
+            R_TRY(this->SetEmptyBuf(buf));
 
-        // waits until either an error or write thread has finished.
-        waitSingle(waiterForUEvent(&uevent), UINT64_MAX);
+            this->acquire_offset += buf.size;
+            this->outstanding++;
+        }
 
-        // wait for all threads to close.
-        for (;;) {
-            t_data.WakeAllThreads();
+        // let the readers exit once they have filled what they were given.
+        if (this->acquire_offset >= this->write_size && !this->acquire_done) {
+            this->acquire_done = true;
+            this->WakeAllThreads();
+        }
 
-            if (R_FAILED(waitSingleHandle(t_read.handle, 1000))) {
-                continue;
-            } else if (R_FAILED(waitSingleHandle(t_write.handle, 1000))) {
-                continue;
-            }
+        ZeroCopyBuffer buf;
+        R_TRY(this->GetFullBuf(buf));
+        if (!buf.data) {
             break;
         }
 
-        R_RETURN(t_data.GetResults());
+        // once passed on, the buffer is no longer ours to release.
+        this->outstanding--;
+        R_TRY(this->wfunc(buf.data, buf.off, buf.size));
+        this->write_offset += buf.size;
+
+        // a short read means the file ended early, and later buffers were read past it.
+        if (buf.last) {
+            break;
+        }
     }
+
+    R_SUCCEED();
 }
 
-} // namespace
+// one of the threads writing buffers for a buffered transfer, with its own rings to the reader.
+struct BufferWriter {
+    Handoff can_write{};
+
+    // there are never more buffers outstanding than either ring holds.
+    SpscRing<ZeroCopyBuffer, MAX_DEPTH> full_buffers{};
+    SpscRing<ZeroCopyBuffer, MAX_DEPTH> done_buffers{};
+
+    std::atomic_bool running{true};
+
+    // only touched by the write thread.
+    u64 stall_ticks{};
+};
+
+// the reader hands filled buffers to the writers, which hand them back once written.
+// buffers are dealt to the writers in turn and recycled in the same order, so the written size only counts
+// data with nothing missing before it.
+// only the reader produces and releases buffers, so they never cross to a third thread.
+// with aligned buffers, the reader copies produced buffers into them and releases the originals straight away.
+// there must be one aligned buffer for each buffer that may be outstanding.
+struct BufferThreadData {
+    BufferThreadData(UEvent& _uevent, s64 size, const ProduceCallback& _pfunc, const WriteCallback& _wfunc, const ReleaseCallback& _ffunc, unsigned depth, unsigned writers, s64 align, const AlignedBuffers* aligned, haze::CancelToken* _cancel);
+
+    auto GetResults() volatile -> Result;
+    void WakeAllThreads();
+
+    unsigned GetReaderCount() const {
+        return 1;
+    }
+
+    // writers can't write more buffers at once than are outstanding.
+    unsigned GetWriterCount() const {
+        return writer_count;
+    }
+
+    void SetReadResult(Result result) {
+        read_result = result;
+        if (R_FAILED(result)) {
+            ueventSignal(&uevent);
+        }
+    }
+
+    // keeps the first failure of any writer.
+    void SetWriteResult(Result result) {
+        if (R_FAILED(result)) {
+            Result expected{Result::SuccessValue};
+            write_result.compare_exchange_strong(expected, result);
+        }
+        ueventSignal(&uevent);
+    }
+
+    // returns every buffer which was produced but never released, threads must have exited.
+    void ReleaseBuffers();
+
+    // threads must have exited.
+    void GetStats(Stats* out) const {
+        u64 write_stall_ticks{};
+        for (unsigned i = 0; i < writer_count; i++) {
+            write_stall_ticks += writers[i].stall_ticks;
+        }
+
+        out->size = write_offset;
+        out->read_stall_ns = armTicksToNs(read_stall_ticks);
+        out->write_stall_ns = armTicksToNs(write_stall_ticks / writer_count);
+    }
+
+    Result readFuncInternal(unsigned index);
+    Result writeFuncInternal(unsigned index);
+
+private:
+    Result ReleaseDoneBufs(bool wait);
+    void ReleaseBuf(void* data);
+    void RecycleBuf(const ZeroCopyBuffer& buf);
+    Result AcquireAlignedBuf(ZeroCopyBuffer& buf_out);
+    Result ProduceAligned(bool& done);
+    Result ProduceBuf(bool& done);
+    Result SetFullBuf(const ZeroCopyBuffer& buf);
+    Result GetFullBuf(BufferWriter& writer, ZeroCopyBuffer& buf_out);
+    Result SetDoneBuf(BufferWriter& writer, const ZeroCopyBuffer& buf);
+
+private:
+    // these need to be copied
+    UEvent& uevent;
+    const ProduceCallback& pfunc;
+    const WriteCallback& wfunc;
+    const ReleaseCallback& ffunc;
+    haze::CancelToken* const cancel;
+
+    // these need to be created
+    Handoff can_read{};
+
+    BufferWriter writers[MAX_WRITERS]{};
+
+    // buffers produced but not yet released, split between waiting to be written and written.
+    const unsigned max_outstanding;
+    const unsigned writer_count;
+    const s64 write_size;
+    const s64 write_align;
+
+    // only used by the read thread.
+    s64 read_offset{};
+    unsigned outstanding{};
+    unsigned produce_count{};
+    unsigned recycle_count{};
+
+    // aligned buffers not in use, which start out as all of them.
+    void* free_aligned_bufs[MAX_DEPTH]{};
+    unsigned free_aligned_count{};
+    // the aligned buffer being filled, which isn't outstanding until handed to a writer.
+    ZeroCopyBuffer pending{};
+
+    // written data with nothing missing before it, counted as buffers are recycled.
+    s64 write_offset{};
+    bool write_failed{};
+
+    // these are shared between threads
+    std::atomic<Result> read_result{Result::SuccessValue};
+    std::atomic<Result> write_result{Result::SuccessValue};
+
+    std::atomic_bool read_running{true};
+
+    // only touched by the read thread.
+    u64 read_stall_ticks{};
+};
+
+BufferThreadData::BufferThreadData(UEvent& _uevent, s64 size, const ProduceCallback& _pfunc, const WriteCallback& _wfunc, const ReleaseCallback& _ffunc, unsigned depth, unsigned writers, s64 align, const AlignedBuffers* aligned, haze::CancelToken* _cancel)
+: uevent{_uevent}
+, pfunc{_pfunc}
+, wfunc{_wfunc}
+, ffunc{_ffunc}
+, cancel{_cancel}
+, max_outstanding{std::clamp(depth, 1U, MAX_DEPTH)}
+, writer_count{std::clamp(writers, 1U, std::min(MAX_WRITERS, max_outstanding))}
+, write_size{size}
+, write_align{aligned ? align : 0} {
+    if (write_align) {
+        for (unsigned i = 0; i < max_outstanding; i++) {
+            free_aligned_bufs[free_aligned_count++] = aligned->bufs[i];
+        }
+    }
+}
+
+auto BufferThreadData::GetResults() volatile -> Result {
+    R_TRY(read_result.load());
+    R_TRY(write_result.load());
+    R_TRY(CheckCancel(cancel));
+    R_SUCCEED();
+}
+
+void BufferThreadData::WakeAllThreads() {
+    can_read.Notify();
+
+    for (unsigned i = 0; i < writer_count; i++) {
+        writers[i].can_write.Notify();
+    }
+}
+
+void BufferThreadData::ReleaseBuffers() {
+    // recycle what was written in order first, so that it is counted.
+    for (;;) {
+        auto& writer = writers[recycle_count % writer_count];
+        if (!writer.done_buffers.ringbuf_size()) {
+            break;
+        }
+
+        ZeroCopyBuffer buf;
+        writer.done_buffers.ringbuf_pop(buf);
+        RecycleBuf(buf);
+    }
+
+    ZeroCopyBuffer buf;
+
+    for (unsigned i = 0; i < writer_count; i++) {
+        auto& writer = writers[i];
+
+        while (writer.full_buffers.ringbuf_size()) {
+            writer.full_buffers.ringbuf_pop(buf);
+            ReleaseBuf(buf.data);
+        }
+
+        while (writer.done_buffers.ringbuf_size()) {
+            writer.done_buffers.ringbuf_pop(buf);
+            ReleaseBuf(buf.data);
+        }
+    }
+}
+
+void BufferThreadData::ReleaseBuf(void* data) {
+    if (write_align) {
+        free_aligned_bufs[free_aligned_count++] = data;
+    } else {
+        ffunc(data);
+    }
+}
+
+void BufferThreadData::RecycleBuf(const ZeroCopyBuffer& buf) {
+    // a failed write leaves a gap, after which nothing counts as written.
+    if (buf.last) {
+        write_failed = true;
+    } else if (!write_failed) {
+        write_offset += buf.size;
+    }
+
+    ReleaseBuf(buf.data);
+    recycle_count++;
+    outstanding--;
+}
+
+Result BufferThreadData::ReleaseDoneBufs(bool wait) {
+    // buffers are recycled in the order they were dealt.
+    for (;;) {
+        auto& writer = writers[recycle_count % writer_count];
+
+        while (wait && !writer.done_buffers.ringbuf_size()) {
+            // recheck the ring, as in ThreadData::GetWriteBuf.
+            if (!writer.running && !writer.done_buffers.ringbuf_size()) {
+                R_SUCCEED();
+            }
+
+            R_TRY(GetResults());
+
+            const auto tick = armGetSystemTick();
+            can_read.Wait([&] { return writer.done_buffers.ringbuf_size() || !writer.running || R_FAILED(GetResults()); });
+            read_stall_ticks += armGetSystemTick() - tick;
+        }
+
+        if (!writer.done_buffers.ringbuf_size()) {
+            R_SUCCEED();
+        }
+
+        ZeroCopyBuffer buf;
+        writer.done_buffers.ringbuf_pop(buf);
+        RecycleBuf(buf);
+        wait = false;
+    }
+}
+
+Result BufferThreadData::SetFullBuf(const ZeroCopyBuffer& buf) {
+    auto& writer = writers[produce_count++ % writer_count];
+
+    writer.full_buffers.ringbuf_push(buf);
+    writer.can_write.Notify();
+    R_SUCCEED();
+}
+
+Result BufferThreadData::GetFullBuf(BufferWriter& writer, ZeroCopyBuffer& buf_out) {
+    while (!writer.full_buffers.ringbuf_size()) {
+        // recheck the ring, as in ThreadData::GetWriteBuf.
+        if (!read_running && !writer.full_buffers.ringbuf_size()) {
+            buf_out = {};
+            R_SUCCEED();
+        }
+
+        R_TRY(GetResults());
+
+        const auto tick = armGetSystemTick();
+        writer.can_write.Wait([&] { return writer.full_buffers.ringbuf_size() || !read_running || R_FAILED(GetResults()); });
+        writer.stall_ticks += armGetSystemTick() - tick;
+    }
+
+    R_TRY(GetResults());
+    writer.full_buffers.ringbuf_pop(buf_out);
+    R_SUCCEED();
+}
+
+Result BufferThreadData::SetDoneBuf(BufferWriter& writer, const ZeroCopyBuffer& buf) {
+    writer.done_buffers.ringbuf_push(buf);
+    can_read.Notify();
+    R_SUCCEED();
+}
+
+// waits for an aligned buffer to be free, returning an empty buffer if the writers have stopped.
+Result BufferThreadData::AcquireAlignedBuf(ZeroCopyBuffer& buf_out) {
+    buf_out = {};
+
+    // recycle written buffers, waiting for one if we have too many.
+    R_TRY(this->ReleaseDoneBufs(this->outstanding >= this->max_outstanding));
+    if (this->outstanding >= this->max_outstanding) {
+        R_SUCCEED();
+    }
+
+    // no more than max_outstanding are ever in use, so one is always free here.
+    buf_out.data = this->free_aligned_bufs[--this->free_aligned_count];
+    buf_out.off = this->read_offset;
+    R_SUCCEED();
+}
+
+// copies the next produced buffer into aligned buffers, handing each to the writers once full.
+Result BufferThreadData::ProduceAligned(bool& done) {
+    void* data{};
+    s64 size{};
+    R_TRY(this->pfunc(std::addressof(data), std::addressof(size)));
+    ON_SCOPE_EXIT {
+        if (data) {
+            this->ffunc(data);
+        }
+    };
+
+    // the end of the data flushes what is left, however short.
+    if (!size) {
+        if (this->pending.size) {
+            this->outstanding++;
+            R_TRY(this->SetFullBuf(std::exchange(this->pending, {})));
+        }
+        done = true;
+        R_SUCCEED();
+    }
+
+    for (s64 copied = 0; copied < size;) {
+        if (!this->pending.data) {
+            R_TRY(this->AcquireAlignedBuf(this->pending));
+            if (!this->pending.data) {
+                done = true;
+                R_SUCCEED();
+            }
+        }
+
+        const auto copy_size = std::min<s64>(this->write_align - this->pending.size, size - copied);
+        std::memcpy(static_cast<u8*>(this->pending.data) + this->pending.size, static_cast<const u8*>(data) + copied, copy_size);
+        this->pending.size += copy_size;
+        this->read_offset += copy_size;
+        copied += copy_size;
+
+        if (this->pending.size == this->write_align || this->read_offset >= this->write_size) {
+            this->outstanding++;
+            R_TRY(this->SetFullBuf(std::exchange(this->pending, {})));
+        }
+    }
+
+    R_SUCCEED();
+}
+
+// hands the next produced buffer to the writers as it is.
+Result BufferThreadData::ProduceBuf(bool& done) {
+    // recycle written buffers, waiting for one if we have too many.
+    R_TRY(this->ReleaseDoneBufs(this->outstanding >= this->max_outstanding));
+    if (this->outstanding >= this->max_outstanding) {
+        done = true;
+        R_SUCCEED();
+    }
+
+    ZeroCopyBuffer buf{};
+    R_TRY(this->pfunc(std::addressof(buf.data), std::addressof(buf.size)));
+    if (!buf.size) {
+        if (buf.data) {
+            this->ffunc(buf.data);
+        }
+        done = true;
+        R_SUCCEED();
+    }
+
+    buf.off = this->read_offset;
+    this->read_offset += buf.size;
+    this->outstanding++;
+    R_RETURN(this->SetFullBuf(buf));
+}
+
+// read thread produces filled buffers, and releases them once written.
+Result BufferThreadData::readFuncInternal(unsigned) {
+    // the writers may be waiting on a buffer that will never come.
+    ON_SCOPE_EXIT {
+        read_running = false;
+        WakeAllThreads();
+    };
+
+    bool done{};
+    while (!done && this->read_offset < this->write_size && R_SUCCEEDED(this->GetResults())) {
+        if (this->write_align) {
+            R_TRY(this->ProduceAligned(done));
+        } else {
+            R_TRY(this->ProduceBuf(done));
+        }
+    }
+
+    R_SUCCEED();
+}
+
+// each write thread writes its buffers to wfunc, then hands them back.
+Result BufferThreadData::writeFuncInternal(unsigned index) {
+    auto& writer = this->writers[index];
+
+    // the reader may be waiting on a buffer that will never come.
+    ON_SCOPE_EXIT {
+        writer.running = false;
+        WakeAllThreads();
+    };
+
+    while (R_SUCCEEDED(this->GetResults())) {
+        ZeroCopyBuffer buf;
+        R_TRY(this->GetFullBuf(writer, buf));
+        if (!buf.data) {
+            break;
+        }
+
+        const auto rc = this->wfunc(buf.data, buf.off, buf.size);
+        buf.last = R_FAILED(rc);
+        R_TRY(this->SetDoneBuf(writer, buf));
+        R_TRY(rc);
+    }
+
+    R_SUCCEED();
+}
+
+template<typename Data>
+struct ThreadArg {
+    Data* data;
+    unsigned index;
+};
+
+template<typename Data>
+void readFunc(void* d) {
+    auto arg = static_cast<ThreadArg<Data>*>(d);
+    arg->data->SetReadResult(arg->data->readFuncInternal(arg->index));
+}
+
+template<typename Data>
+void writeFunc(void* d) {
+    auto arg = static_cast<ThreadArg<Data>*>(d);
+    arg->data->SetWriteResult(arg->data->writeFuncInternal(arg->index));
+}
+
+// a thread kept open between transfers, which runs one job at a time.
+struct Worker {
+    Thread thread;
+    // signalled to start the job, and by the worker once the job has finished.
+    UEvent start_event;
+    UEvent done_event;
+    ThreadFunc func;
+    void* arg;
+    std::atomic_bool quit;
+};
+
+struct WorkerPool {
+    Worker read[MAX_READERS];
+    Worker write[MAX_WRITERS];
+    // workers past the first of each are opened as transfers need them.
+    unsigned read_count;
+    unsigned write_count;
+    int prio;
+    u64 core_mask;
+    bool open;
+    // kept between transfers, as they're large and every upload to the same filesystem wants the same size.
+    AlignedBuffers aligned;
+};
+
+WorkerPool g_pool{};
+
+void workerFunc(void* d) {
+    auto w = static_cast<Worker*>(d);
+
+    for (;;) {
+        waitSingle(waiterForUEvent(&w->start_event), UINT64_MAX);
+        if (w->quit) {
+            break;
+        }
+
+        w->func(w->arg);
+        ueventSignal(&w->done_event);
+    }
+}
+
+Result OpenWorker(Worker& w, int prio, u64 core_mask) {
+    ueventCreate(&w.start_event, true);
+    ueventCreate(&w.done_event, false);
+    w.quit = false;
+
+    R_TRY(utils::CreateThread(&w.thread, workerFunc, &w, 1024*128, prio, core_mask));
+    if (const auto rc = threadStart(&w.thread); R_FAILED(rc)) {
+        threadClose(&w.thread);
+        R_THROW(rc);
+    }
+
+    R_SUCCEED();
+}
+
+void CloseWorker(Worker& w) {
+    w.quit = true;
+    ueventSignal(&w.start_event);
+    threadWaitForExit(&w.thread);
+    threadClose(&w.thread);
+}
+
+void StartWorker(Worker& w, ThreadFunc func, void* arg) {
+    w.func = func;
+    w.arg = arg;
+    ueventClear(&w.done_event);
+    ueventSignal(&w.start_event);
+}
+
+Result GrowWorkers(Worker* workers, unsigned& count, unsigned new_count, int prio, u64 core_mask) {
+    while (count < new_count) {
+        R_TRY(OpenWorker(workers[count], prio, core_mask));
+        count++;
+    }
+
+    R_SUCCEED();
+}
+
+Result GrowWorkerPool(unsigned read_count, unsigned write_count, int prio, u64 core_mask) {
+    R_TRY(GrowWorkers(g_pool.read, g_pool.read_count, read_count, prio, core_mask));
+    R_TRY(GrowWorkers(g_pool.write, g_pool.write_count, write_count, prio, core_mask));
+    R_SUCCEED();
+}
+
+// waits for the read and write jobs to finish, which signal their waiters.
+template<typename Data>
+Result WaitThreads(Data& t_data, UEvent& uevent, const Waiter* done, unsigned count, haze::EventReactor* reactor) {
+    // waits until either an error or write thread has finished, or the transfer is cancelled.
+    if (reactor) {
+        // requests from the host, such as a cancel, are handled here as the thread using the transport
+        // may be waiting on a ring rather than on the reactor. the threads report any failure themselves.
+        s32 idx;
+        reactor->Serve(&idx, waiterForUEvent(&uevent));
+
+        // the threads handle them again while they finish.
+        reactor->EndServing();
+    } else {
+        waitSingle(waiterForUEvent(&uevent), UINT64_MAX);
+    }
+
+    // wait for all threads to finish, waking them again in case one was about to wait.
+    for (unsigned i = 0; i < count;) {
+        t_data.WakeAllThreads();
+
+        if (R_SUCCEEDED(waitSingle(done[i], EXIT_WAKE_INTERVAL_NS))) {
+            i++;
+        }
+    }
+
+    R_RETURN(t_data.GetResults());
+}
+
+template<typename Data>
+Result RunThreads(Data& t_data, UEvent& uevent, haze::EventReactor* reactor = nullptr) {
+    const auto read_count = t_data.GetReaderCount();
+    const auto write_count = t_data.GetWriterCount();
+    const auto count = read_count + write_count;
+
+    // readers first, then writers.
+    ThreadArg<Data> args[MAX_READERS + MAX_WRITERS];
+    ThreadFunc funcs[MAX_READERS + MAX_WRITERS];
+    Waiter done[MAX_READERS + MAX_WRITERS];
+    for (unsigned i = 0; i < count; i++) {
+        const auto is_read = i < read_count;
+        args[i] = {std::addressof(t_data), is_read ? i : i - read_count};
+        funcs[i] = is_read ? readFunc<Data> : writeFunc<Data>;
+    }
+
+    // taken before any thread starts, so that only this thread handles the reactor's events until WaitThreads,
+    // which gives them back once it stops serving.
+    if (g_pool.open && R_SUCCEEDED(GrowWorkerPool(read_count, write_count, g_pool.prio, g_pool.core_mask))) {
+        if (reactor) {
+            reactor->BeginServing();
+        }
+
+        for (unsigned i = 0; i < count; i++) {
+            auto& w = i < read_count ? g_pool.read[i] : g_pool.write[i - read_count];
+            StartWorker(w, funcs[i], std::addressof(args[i]));
+            done[i] = waiterForUEvent(&w.done_event);
+        }
+
+        R_RETURN(WaitThreads(t_data, uevent, done, count, reactor));
+    }
+
+    Thread threads[MAX_READERS + MAX_WRITERS]{};
+    unsigned created{};
+    ON_SCOPE_EXIT {
+        for (unsigned i = 0; i < created; i++) {
+            threadClose(&threads[i]);
+        }
+    };
+
+    for (unsigned i = 0; i < count; i++) {
+        R_TRY(utils::CreateThread(&threads[i], funcs[i], std::addressof(args[i])));
+        done[i] = waiterForHandle(threads[i].handle);
+        created++;
+    }
+
+    if (reactor) {
+        reactor->BeginServing();
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        if (const auto rc = threadStart(std::addressof(threads[i])); R_FAILED(rc)) {
+            if (reactor) {
+                reactor->EndServing();
+            }
+            R_THROW(rc);
+        }
+    }
+
+    ON_SCOPE_EXIT {
+        for (unsigned i = 0; i < count; i++) {
+            threadWaitForExit(std::addressof(threads[i]));
+        }
+    };
+
+    R_RETURN(WaitThreads(t_data, uevent, done, count, reactor));
+}
+
+Result TransferInternal(s64 size, const ReadCallback& rfunc, const WriteCallback& wfunc, Mode mode, unsigned depth, u64 buffer_size = BUFFER_SIZE) {
+    if (mode == Mode::SingleThreadedIfSmaller) {
+        if ((u64)size <= buffer_size) {
+            mode = Mode::SingleThreaded;
+        } else {
+            mode = Mode::MultiThreaded;
+        }
+    }
+
+    buffer_size = std::min<u64>(size, buffer_size);
+
+    if (mode == Mode::SingleThreaded) {
+        std::vector<u8> buf(buffer_size);
+
+        s64 offset{};
+        while (offset < size) {
+            u64 bytes_read;
+            const auto rsize = std::min<s64>(buf.size(), size - offset);
+            R_TRY(rfunc(buf.data(), offset, rsize, &bytes_read));
+            if (!bytes_read) {
+                break;
+            }
+
+            R_TRY(wfunc(buf.data(), offset, bytes_read));
+
+            offset += bytes_read;
+        }
+
+        R_SUCCEED();
+    }
+    else {
+        UEvent uevent;
+        ueventCreate(&uevent, false);
+        ThreadData t_data{uevent, size, rfunc, wfunc, buffer_size, depth};
+
+        R_RETURN(RunThreads(t_data, uevent));
+    }
+}
+
+Result TransferZeroCopyInternal(s64 size, const AcquireCallback& afunc, const ReadCallback& rfunc, const ConsumeCallback& wfunc, const ReleaseCallback& ffunc, Mode mode, unsigned depth, Stats* stats, haze::EventReactor* reactor, unsigned readers) {
+    const auto cancel = GetCancelToken(reactor);
+
+    // buffer size is decided by afunc, so assume the default.
+    if (mode == Mode::SingleThreadedIfSmaller) {
+        if ((u64)size <= BUFFER_SIZE) {
+            mode = Mode::SingleThreaded;
+        } else {
+            mode = Mode::MultiThreaded;
+        }
+    }
+
+    if (mode == Mode::SingleThreaded) {
+        s64 offset{};
+        while (offset < size) {
+            R_TRY(CheckCancel(cancel));
+
+            void* data;
+            s64 buf_size;
+            R_TRY(afunc(&data, &buf_size));
+
+            // fill the whole buffer, as a partial buffer ends the transfer.
+            s64 filled{};
+            const auto rsize = std::min<s64>(buf_size, size - offset);
+            while (filled < rsize) {
+                u64 bytes_read{};
+                if (const auto rc = rfunc((u8*)data + filled, offset + filled, rsize - filled, &bytes_read); R_FAILED(rc)) {
+                    ffunc(data);
+                    R_THROW(rc);
+                }
+
+                if (!bytes_read) {
+                    break;
+                }
+
+                filled += bytes_read;
+            }
+
+            if (!filled) {
+                ffunc(data);
+                break;
+            }
+
+            R_TRY(wfunc(data, offset, filled));
+
+            offset += filled;
+            stats->size = offset;
+            if (filled < rsize) {
+                break;
+            }
+        }
+
+        R_SUCCEED();
+    }
+    else {
+        UEvent uevent;
+        ueventCreate(&uevent, false);
+        ZeroCopyThreadData t_data{uevent, size, afunc, rfunc, wfunc, depth, readers, cancel};
+
+        // runs once all threads have exited.
+        ON_SCOPE_EXIT {
+            t_data.ReleaseBuffers(ffunc);
+            t_data.GetStats(stats);
+        };
+
+        R_RETURN(RunThreads(t_data, uevent, reactor));
+    }
+}
+
+Result TransferBuffersInternal(s64 size, const ProduceCallback& pfunc, const WriteCallback& wfunc, const ReleaseCallback& ffunc, Mode mode, unsigned depth, Stats* stats, haze::EventReactor* reactor, unsigned writers, s64 align) {
+    const auto cancel = GetCancelToken(reactor);
+
+    // the aligned buffers come from the pool, or are ours for this transfer while it's closed.
+    align = std::clamp<s64>(align, 0, MAX_WRITE_ALIGN);
+
+    AlignedBuffers local_aligned{};
+    ON_SCOPE_EXIT { local_aligned.Free(); };
+    auto& aligned = g_pool.open ? g_pool.aligned : local_aligned;
+
+    // buffer size is decided by pfunc, so assume the default.
+    if (mode == Mode::SingleThreadedIfSmaller) {
+        if ((u64)size <= BUFFER_SIZE) {
+            mode = Mode::SingleThreaded;
+        } else {
+            mode = Mode::MultiThreaded;
+        }
+    }
+
+    if (mode == Mode::SingleThreaded) {
+        u8* aligned_buf{};
+        if (align) {
+            R_TRY(aligned.Reserve(1, align));
+            aligned_buf = static_cast<u8*>(aligned.bufs[0]);
+        }
+
+        s64 offset{};
+        s64 filled{};
+        while (offset < size) {
+            R_TRY(CheckCancel(cancel));
+
+            void* data{};
+            s64 buf_size{};
+            R_TRY(pfunc(&data, &buf_size));
+            ON_SCOPE_EXIT {
+                if (data) {
+                    ffunc(data);
+                }
+            };
+
+            if (!buf_size) {
+                break;
+            }
+
+            if (aligned_buf) {
+                // write each aligned buffer once it's full, and what is left once the data ends.
+                for (s64 copied = 0; copied < buf_size;) {
+                    const auto copy_size = std::min<s64>(align - filled, buf_size - copied);
+                    std::memcpy(aligned_buf + filled, static_cast<const u8*>(data) + copied, copy_size);
+                    filled += copy_size;
+                    copied += copy_size;
+
+                    if (filled == align || offset + filled >= size) {
+                        R_TRY(wfunc(aligned_buf, offset, filled));
+                        offset += filled;
+                        stats->size = offset;
+                        filled = 0;
+                    }
+                }
+                continue;
+            }
+
+            R_TRY(wfunc(data, offset, buf_size));
+
+            offset += buf_size;
+            stats->size = offset;
+        }
+
+        if (filled) {
+            R_TRY(wfunc(aligned_buf, offset, filled));
+            stats->size = offset + filled;
+        }
+
+        R_SUCCEED();
+    }
+    else {
+        if (align) {
+            depth = GetAlignedDepth(depth, align);
+            R_TRY(aligned.Reserve(depth, align));
+        }
+
+        UEvent uevent;
+        ueventCreate(&uevent, false);
+        BufferThreadData t_data{uevent, size, pfunc, wfunc, ffunc, depth, writers, align, align ? std::addressof(aligned) : nullptr, cancel};
+
+        // runs once all threads have exited.
+        ON_SCOPE_EXIT {
+            t_data.ReleaseBuffers();
+            t_data.GetStats(stats);
+        };
+
+        R_RETURN(RunThreads(t_data, uevent, reactor));
+    }
+}
+
+template<typename F>
+Result MeasureTransfer(Stats* stats, F&& func) {
+    *stats = {};
+
+    const auto tick = armGetSystemTick();
+    ON_SCOPE_EXIT { stats->elapsed_ns = armTicksToNs(armGetSystemTick() - tick); };
+
+    return func(stats);
+}
+
+} // namespace
+
+Result OpenWorkerPool(int prio, u64 core_mask) {
+    if (g_pool.open) {
+        R_SUCCEED();
+    }
+
+    g_pool.prio = prio;
+    g_pool.core_mask = core_mask;
+    g_pool.open = true;
+
+    if (const auto rc = GrowWorkerPool(1, 1, prio, core_mask); R_FAILED(rc)) {
+        CloseWorkerPool();
+        R_THROW(rc);
+    }
+
+    R_SUCCEED();
+}
+
+void CloseWorkerPool() {
+    if (!g_pool.open) {
+        return;
+    }
+
+    for (unsigned i = 0; i < g_pool.read_count; i++) {
+        CloseWorker(g_pool.read[i]);
+    }
+    for (unsigned i = 0; i < g_pool.write_count; i++) {
+        CloseWorker(g_pool.write[i]);
+    }
+
+    g_pool.aligned.Free();
+    g_pool.read_count = 0;
+    g_pool.write_count = 0;
+    g_pool.open = false;
+}
+
+Result Transfer(s64 size, const ReadCallback& rfunc, const WriteCallback& wfunc, Mode mode, unsigned depth) {
+    return TransferInternal(size, rfunc, wfunc, mode, depth);
+}
+
+Result TransferZeroCopy(s64 size, const AcquireCallback& afunc, const ReadCallback& rfunc, const ConsumeCallback& wfunc, const ReleaseCallback& ffunc, Mode mode, unsigned depth, Stats* stats, haze::EventReactor* reactor, unsigned readers) {
+    Stats dummy_stats;
+    return MeasureTransfer(stats ? stats : &dummy_stats, [&](Stats* out) {
+        return TransferZeroCopyInternal(size, afunc, rfunc, wfunc, ffunc, mode, depth, out, reactor, readers);
+    });
+}
 
-Result Transfer(s64 size, const ReadCallback& rfunc, const WriteCallback& wfunc, Mode mode) {
-    return TransferInternal(size, rfunc, wfunc, mode);
+Result TransferBuffers(s64 size, const ProduceCallback& pfunc, const WriteCallback& wfunc, const ReleaseCallback& ffunc, Mode mode, unsigned depth, Stats* stats, haze::EventReactor* reactor, unsigned writers, s64 align) {
+    Stats dummy_stats;
+    return MeasureTransfer(stats ? stats : &dummy_stats, [&](Stats* out) {
+        return TransferBuffersInternal(size, pfunc, wfunc, ffunc, mode, depth, out, reactor, writers, align);
+    });
 }
 
 } // namespace::thread
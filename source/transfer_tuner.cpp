@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) Atmosphère-NX
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <haze.hpp>
+#include <haze/transfer_tuner.hpp>
+
+namespace haze {
+
+    namespace {
+
+        /* The first candidate of each direction is the default, used until a transfer is large enough to measure. */
+        /* A depth of zero marks an unused candidate. */
+        constexpr TransferConfig Candidates[TransferDirection_Count][TransferTuner::CandidateCount] = {
+            /* TransferDirection_ToHost */
+            {
+                { .packet_count = 4, .depth = 2 },
+                { .packet_count = 2, .depth = 1 },
+                { .packet_count = 4, .depth = 3 },
+                { .packet_count = 8, .depth = 4 },
+            },
+            /* TransferDirection_FromHost */
+            /* Received packets are queued before the transfer is known, so only the depth can change. */
+            {
+                { .packet_count = 0, .depth = 2 },
+                { .packet_count = 0, .depth = 1 },
+                { .packet_count = 0, .depth = 3 },
+                { .packet_count = 0, .depth = 0 },
+            },
+        };
+
+    }
+
+    TransferTuner::Entry &TransferTuner::GetEntry(u32 storage_id, TransferDirection direction) {
+        for (auto &entry : m_entries) {
+            if (entry.storage_id == storage_id && entry.direction == direction) {
+                return entry;
+            }
+        }
+
+        return m_entries.emplace_back(Entry{ .storage_id = storage_id, .direction = direction, .bytes_per_second = {}, .next_candidate = 0, .best_candidate = 0, .storage_bound = false });
+    }
+
+    TransferConfig TransferTuner::Select(u32 storage_id, TransferDirection direction, s64 size, u32 *out_candidate) {
+        Entry &entry = this->GetEntry(storage_id, direction);
+        u32 candidate = entry.best_candidate;
+
+        /* Only transfers large enough to measure are used to try candidates. */
+        if (size >= MinSampleSize) {
+            for (; entry.next_candidate < CandidateCount; entry.next_candidate++) {
+                const TransferConfig &config = Candidates[direction][entry.next_candidate];
+
+                /* Deeper queues cannot help once the storage is known to be the bottleneck. */
+                if (config.depth == 0 || (entry.storage_bound && config.depth > Candidates[direction][0].depth)) {
+                    continue;
+                }
+
+                candidate = entry.next_candidate;
+                break;
+            }
+        }
+
+        *out_candidate = candidate;
+        return Candidates[direction][candidate];
+    }
+
+    void TransferTuner::Report(u32 storage_id, TransferDirection direction, u32 candidate, const sphaira::thread::Stats &stats) {
+        /* Small transfers are dominated by setup costs, and tell us nothing. */
+        if (stats.size < MinSampleSize || stats.elapsed_ns == 0) {
+            return;
+        }
+
+        Entry &entry = this->GetEntry(storage_id, direction);
+
+        /* Smooth over samples, as a single transfer may be disturbed by the host. */
+        const u64 bytes_per_second = static_cast<u64>(static_cast<double>(stats.size) * 1'000'000'000.0 / stats.elapsed_ns);
+
+        u64 &average = entry.bytes_per_second[candidate];
+        average = average == 0 ? bytes_per_second : (average * 3 + bytes_per_second) / 4;
+
+        /* Note whether the USB thread spent most of the default transfer waiting on the storage. */
+        if (candidate == 0) {
+            const u64 storage_stall_ns = direction == TransferDirection_ToHost ? stats.write_stall_ns : stats.read_stall_ns;
+            entry.storage_bound = storage_stall_ns * 4 > stats.elapsed_ns * 3;
+        }
+
+        if (candidate == entry.next_candidate) {
+            entry.next_candidate++;
+        }
+
+        /* Use whichever candidate is currently fastest. */
+        for (u32 i = 0; i < CandidateCount; i++) {
+            if (entry.bytes_per_second[i] > entry.bytes_per_second[entry.best_candidate]) {
+                entry.best_candidate = i;
+            }
+        }
+    }
+
+}
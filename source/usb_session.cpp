@@ -21,6 +21,31 @@ namespace haze {
 
         constexpr const u32 DefaultInterfaceNumber = 0;
 
+        /* URBs which have been posted but not yet completed report one of these states. */
+        constexpr const u32 UrbStatusPending = 0x1;
+        constexpr const u32 UrbStatusRunning = 0x2;
+
+        /* The data stage of a control request follows its setup packet immediately. */
+        constexpr const u64 ControlTransferTimeoutNs = 100'000'000;
+
+        alignas(4_KB) constinit u8 g_usb_control_buffer[4_KB] = {};
+
+        Result WaitControlTransfer(UsbDsInterface *interface, bool in, u32 urb_id, u32 *out_transferred_size) {
+            Event *completion_event = in ? std::addressof(interface->CtrlInCompletionEvent) : std::addressof(interface->CtrlOutCompletionEvent);
+
+            R_TRY(eventWait(completion_event, ControlTransferTimeoutNs));
+            R_TRY(eventClear(completion_event));
+
+            UsbDsReportData report_data;
+            if (in) {
+                R_TRY(usbDsInterface_GetCtrlInReportData(interface, std::addressof(report_data)));
+            } else {
+                R_TRY(usbDsInterface_GetCtrlOutReportData(interface, std::addressof(report_data)));
+            }
+
+            R_RETURN(usbDsParseReportData(std::addressof(report_data), urb_id, nullptr, out_transferred_size));
+        }
+
     }
 
     Result UsbSession::Initialize1x(const UsbCommsInterfaceInfo *info) {
@@ -260,4 +285,66 @@ namespace haze {
         R_SUCCEED();
     }
 
+    Result UsbSession::QueryTransferResult(UsbSessionEndpoint ep, u32 urb_id, bool *out_complete, u32 *out_transferred_size) {
+        UsbDsReportData report_data;
+
+        /* Clear the event before sampling, so that a later completion will signal it again. */
+        R_TRY(eventClear(std::addressof(m_endpoints[ep]->CompletionEvent)));
+        R_TRY(usbDsEndpoint_GetReportData(m_endpoints[ep], std::addressof(report_data)));
+
+        /* Find the requested URB, and check whether it is still in flight. */
+        const u32 report_count = std::min<u32>(report_data.report_count, util::size(report_data.report));
+        for (u32 i = 0; i < report_count; i++) {
+            const auto &entry = report_data.report[i];
+            if (entry.id == urb_id && (entry.urb_status == UrbStatusPending || entry.urb_status == UrbStatusRunning)) {
+                *out_complete = false;
+                R_SUCCEED();
+            }
+        }
+
+        /* The URB is no longer in flight, so parse its final status. */
+        *out_complete = true;
+        R_RETURN(usbDsParseReportData(std::addressof(report_data), urb_id, nullptr, out_transferred_size));
+    }
+
+    Result UsbSession::CancelTransfers(UsbSessionEndpoint ep) {
+        R_RETURN(usbDsEndpoint_Cancel(m_endpoints[ep]));
+    }
+
+    Event *UsbSession::GetSetupEvent() const {
+        return std::addressof(m_interface->SetupEvent);
+    }
+
+    Result UsbSession::GetSetupPacket(UsbSetupPacket *out_setup) {
+        R_TRY(eventClear(std::addressof(m_interface->SetupEvent)));
+        R_RETURN(usbDsInterface_GetSetupPacket(m_interface, out_setup, sizeof(*out_setup)));
+    }
+
+    Result UsbSession::ControlTransferIn(const void *data, u32 size) {
+        R_UNLESS(size <= sizeof(g_usb_control_buffer), haze::ResultInvalidArgument());
+
+        if (size > 0) {
+            std::memcpy(g_usb_control_buffer, data, size);
+        }
+
+        u32 urb_id, transferred_size;
+        R_TRY(usbDsInterface_CtrlInPostBufferAsync(m_interface, g_usb_control_buffer, size, std::addressof(urb_id)));
+        R_RETURN(WaitControlTransfer(m_interface, true, urb_id, std::addressof(transferred_size)));
+    }
+
+    Result UsbSession::ControlTransferOut(void *data, u32 size, u32 *out_transferred_size) {
+        R_UNLESS(size <= sizeof(g_usb_control_buffer), haze::ResultInvalidArgument());
+
+        u32 urb_id;
+        R_TRY(usbDsInterface_CtrlOutPostBufferAsync(m_interface, g_usb_control_buffer, size, std::addressof(urb_id)));
+        R_TRY(WaitControlTransfer(m_interface, false, urb_id, out_transferred_size));
+
+        std::memcpy(data, g_usb_control_buffer, std::min(size, *out_transferred_size));
+        R_SUCCEED();
+    }
+
+    Result UsbSession::StallControl() {
+        R_RETURN(usbDsInterface_StallCtrl(m_interface));
+    }
+
 }